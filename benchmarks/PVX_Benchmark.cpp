@@ -0,0 +1,450 @@
+#include <PVX_NeuralNetsCPU.h>
+#include <PVX_Solvers.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace PVX::DeepNeuralNets;
+
+namespace {
+	struct Options {
+		double MinTime = 0.1;
+		int Repetitions = 5;
+		int Threads = 0;
+		int Quick = 0;
+		std::string Filter;
+		std::string Output;
+	};
+
+	struct Result {
+		std::string Group, Name;
+		std::vector<std::pair<std::string, std::string>> Params;
+		size_t Iterations = 0;
+		double Median = 0, Min = 0, Flops = 0, Items = 0, Baseline = 0;
+	};
+
+	const char* ActivationName(LayerActivation a) {
+		switch (a) {
+			case LayerActivation::Tanh: return "Tanh";
+			case LayerActivation::TanhBias: return "TanhBias";
+			case LayerActivation::ReLU: return "ReLU";
+			case LayerActivation::Sigmoid: return "Sigmoid";
+			case LayerActivation::Linear: return "Linear";
+		}
+		return "";
+	}
+	const char* SchemeName(TrainScheme t) {
+		switch (t) {
+			case TrainScheme::Adam: return "Adam";
+			case TrainScheme::RMSprop: return "RMSprop";
+			case TrainScheme::Momentum: return "Momentum";
+			case TrainScheme::AdaGrad: return "AdaGrad";
+			case TrainScheme::Sgd: return "Sgd";
+		}
+		return "";
+	}
+	const LayerActivation Activations[] = { LayerActivation::Tanh, LayerActivation::TanhBias, LayerActivation::ReLU, LayerActivation::Sigmoid, LayerActivation::Linear };
+	const TrainScheme Schemes[] = { TrainScheme::Adam, TrainScheme::RMSprop, TrainScheme::Momentum, TrainScheme::AdaGrad, TrainScheme::Sgd };
+
+	std::string Escape(const std::string& s) {
+		std::string ret;
+		for (char c : s) {
+			if (c == '"' || c == '\\') ret += '\\';
+			ret += c;
+		}
+		return ret;
+	}
+
+	class Runner {
+		Options Opt;
+		std::vector<Result> Results;
+		int64_t Version = 0;
+	public:
+		Runner(const Options& Opt) : Opt{ Opt } {}
+		int64_t NextVersion() { return ++Version; }
+
+		template<typename F>
+		double Run(Result r, F&& Body) {
+			if (Opt.Filter.size() && (r.Group + "/" + r.Name).find(Opt.Filter) == std::string::npos) return 0;
+			using Clock = std::chrono::steady_clock;
+			Body();
+			size_t n = 1;
+			for (;;) {
+				auto t0 = Clock::now();
+				for (size_t i = 0; i < n; i++) Body();
+				double dt = std::chrono::duration<double>(Clock::now() - t0).count();
+				if (dt >= Opt.MinTime || n >= (size_t(1) << 30)) break;
+				n = dt > 0 ? std::max(n * 2, size_t(n * 1.2 * Opt.MinTime / dt)) : n * 16;
+			}
+			std::vector<double> Samples;
+			for (int k = 0; k < Opt.Repetitions; k++) {
+				auto t0 = Clock::now();
+				for (size_t i = 0; i < n; i++) Body();
+				Samples.push_back(std::chrono::duration<double>(Clock::now() - t0).count() / n);
+			}
+			std::sort(Samples.begin(), Samples.end());
+			r.Iterations = n;
+			r.Min = Samples.front();
+			r.Median = Samples[Samples.size() / 2];
+			std::cerr << r.Group << "/" << r.Name;
+			for (auto& [k, v] : r.Params) std::cerr << " " << k << "=" << v;
+			std::cerr << " " << r.Median * 1e6 << "us";
+			if (r.Baseline > 0) std::cerr << " (" << r.Baseline / r.Median << "x)";
+			std::cerr << "\n";
+			Results.push_back(r);
+			return r.Median;
+		}
+
+		void Write(std::ostream& out) const {
+			out << "{\n\t\"context\": {\n";
+			out << "\t\t\"eigen\": \"" << EIGEN_WORLD_VERSION << "." << EIGEN_MAJOR_VERSION << "." << EIGEN_MINOR_VERSION << "\",\n";
+			out << "\t\t\"eigen_threads\": " << Eigen::nbThreads() << ",\n";
+			out << "\t\t\"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n";
+			out << "\t\t\"simd\": \"" << Eigen::SimdInstructionSetsInUse() << "\",\n";
+			out << "\t\t\"min_time\": " << Opt.MinTime << ",\n";
+			out << "\t\t\"repetitions\": " << Opt.Repetitions << "\n";
+			out << "\t},\n\t\"benchmarks\": [";
+			for (size_t i = 0; i < Results.size(); i++) {
+				const auto& r = Results[i];
+				out << (i ? ",\n" : "\n") << "\t\t{ \"group\": \"" << r.Group << "\", \"name\": \"" << r.Name << "\", \"params\": {";
+				for (size_t p = 0; p < r.Params.size(); p++)
+					out << (p ? ", " : " ") << "\"" << r.Params[p].first << "\": \"" << Escape(r.Params[p].second) << "\"";
+				out << " }, \"iterations\": " << r.Iterations
+					<< ", \"median_ns\": " << r.Median * 1e9
+					<< ", \"min_ns\": " << r.Min * 1e9;
+				if (r.Flops > 0) out << ", \"gflops\": " << r.Flops / r.Median * 1e-9;
+				if (r.Items > 0) out << ", \"items_per_second\": " << r.Items / r.Median;
+				if (r.Baseline > 0) out << ", \"speedup\": " << r.Baseline / r.Median;
+				out << " }";
+			}
+			out << "\n\t]\n}\n";
+		}
+	};
+
+	void DenseLayers(Runner& Run, const Options& Opt) {
+		std::vector<size_t> Widths = Opt.Quick ? std::vector<size_t>{ 64, 256 } : std::vector<size_t>{ 64, 256, 1024 };
+		std::vector<size_t> Batches = Opt.Quick ? std::vector<size_t>{ 1, 32 } : std::vector<size_t>{ 1, 32, 256 };
+		for (auto Width : Widths) {
+			for (auto Batch : Batches) {
+				InputLayer Input(Width);
+				NeuronLayer Dense(&Input, Width, LayerActivation::ReLU);
+				Input.Input(netData::Random(Width, Batch));
+				netData Gradient = netData::Random(Width, Batch);
+				double w = double(Width), b = double(Batch);
+				Result r{ "dense", "forward", { { "width", std::to_string(Width) }, { "batch", std::to_string(Batch) } } };
+				r.Flops = 2.0 * w * (w + 1.0) * b + w * b;
+				Run.Run(r, [&] { Dense.FeedForward(Run.NextVersion()); });
+				r.Name = "backward";
+				r.Flops = 2.0 * w * (w + 1.0) * b + 2.0 * w * b;
+				Run.Run(r, [&] { Dense.BackPropagate(Gradient); });
+			}
+		}
+	}
+
+	void ActivationLayers(Runner& Run, const Options& Opt) {
+		const size_t Width = 1024, Batch = Opt.Quick ? 32 : 256;
+		for (auto a : Activations) {
+			InputLayer Input(Width);
+			ActivationLayer Act(&Input, a);
+			Input.Input(netData::Random(Width, Batch));
+			netData Gradient = netData::Random(Width, Batch);
+			Result r{ "activation", "forward", { { "activation", ActivationName(a) }, { "width", std::to_string(Width) }, { "batch", std::to_string(Batch) } } };
+			r.Items = double(Width * Batch);
+			Act.FeedForward(Run.NextVersion());
+			Run.Run(r, [&] { Act.FeedForward(Run.NextVersion()); });
+			r.Name = "derivative";
+			Run.Run(r, [&] { Act.BackPropagate(Gradient); });
+		}
+	}
+
+	void TrainSchemes(Runner& Run, const Options& Opt) {
+		const size_t Width = Opt.Quick ? 128 : 256, Batch = 32, Depth = 3;
+		for (float L2 : { 0.0f, 1e-4f }) {
+			NeuralLayer_Base::L2Regularization(L2);
+			for (auto t : Schemes) {
+				InputLayer Input(Width);
+				std::vector<std::unique_ptr<NeuronLayer>> Dense;
+				for (size_t i = 0; i < Depth; i++)
+					Dense.push_back(std::make_unique<NeuronLayer>(i ? (NeuralLayer_Base*)Dense.back().get() : &Input, Width, LayerActivation::ReLU, t));
+				Input.Input(netData::Random(Width, Batch));
+				Dense.back()->FeedForward(Run.NextVersion());
+				Dense.back()->BackPropagate(netData::Random(Width, Batch));
+				double w = double(Width), b = double(Batch), d = double(Depth);
+				Result r{ "update", SchemeName(t), { { "layers", std::to_string(Depth) }, { "width", std::to_string(Width) }, { "batch", std::to_string(Batch) }, { "l2", L2 > 0 ? "1" : "0" } } };
+				r.Flops = d * 2.0 * w * (w + 1.0) * b;
+				r.Items = d * w * (w + 1.0);
+				// NeuronLayer::UpdateWeights does not recurse, so every dense layer is updated explicitly
+				Run.Run(r, [&] { for (auto& l : Dense) l->UpdateWeights(); });
+			}
+		}
+		NeuralLayer_Base::L2Regularization(0.0f);
+	}
+
+	template<typename Layer>
+	void FanIn(Runner& Run, const Options& Opt, const char* Name) {
+		const size_t Width = Opt.Quick ? 128 : 256, Batch = 64;
+		for (size_t Fan : { 2, 4, 8 }) {
+			std::vector<std::unique_ptr<InputLayer>> Inputs;
+			std::vector<NeuralLayer_Base*> Pointers;
+			for (size_t i = 0; i < Fan; i++) {
+				Inputs.push_back(std::make_unique<InputLayer>(Width));
+				Inputs.back()->Input(netData::Random(Width, Batch));
+				Pointers.push_back(Inputs.back().get());
+			}
+			Layer Join(Pointers);
+			Join.FeedForward(Run.NextVersion());
+			netData Gradient = netData::Random(Join.nOutput(), Batch);
+			Result r{ Name, "forward", { { "fan_in", std::to_string(Fan) }, { "width", std::to_string(Width) }, { "batch", std::to_string(Batch) } } };
+			r.Items = double(Fan * Width * Batch);
+			Run.Run(r, [&] { Join.FeedForward(Run.NextVersion()); });
+			r.Name = "backward";
+			Run.Run(r, [&] { Join.BackPropagate(Gradient); });
+		}
+	}
+
+	void Population(Runner& Run, const Options& Opt) {
+		const size_t Width = Opt.Quick ? 64 : 256, Count = 64;
+		for (size_t Batch : { 1, 32 }) {
+			InputLayer Input(16);
+			NeuronLayer Dense0(&Input, Width, LayerActivation::ReLU);
+			NeuronLayer Dense1(&Dense0, Width, LayerActivation::ReLU);
+			NeuronLayer Dense2(&Dense1, 4, LayerActivation::Linear);
+			NetContainer Net(&Dense2);
+			auto DNA = Net.GetDNA();
+			std::vector<std::vector<float>> Candidates(Count, DNA.GetData());
+			std::vector<const float*> Pointers;
+			for (auto& c : Candidates) {
+				Eigen::Map<netData>(c.data(), c.size(), 1) += 0.01f * netData::Random(c.size(), 1);
+				Pointers.push_back(c.data());
+			}
+			netData In = netData::Random(16, Batch);
+			Result r{ "population", "serial", { { "population", std::to_string(Count) }, { "width", std::to_string(Width) }, { "batch", std::to_string(Batch) } } };
+			r.Items = double(Count * Batch);
+			Run.Run(r, [&] {
+				for (auto c : Pointers) {
+					DNA.SetData(c);
+					Net.Process(In);
+				}
+			});
+			PopulationEvaluator Eval(Net, Opt.Threads);
+			r.Name = "evaluator";
+			Run.Run(r, [&] { Eval.Process(Pointers, In); });
+		}
+	}
+
+	const char* EncodingName(WeightEncoding e) {
+		switch (e) {
+			case WeightEncoding::Float32: return "Float32";
+			case WeightEncoding::Float16: return "Float16";
+			case WeightEncoding::BFloat16: return "BFloat16";
+			case WeightEncoding::ShuffleLZ: return "ShuffleLZ";
+		}
+		return "";
+	}
+
+	std::string Scientific(double v) {
+		std::ostringstream ss;
+		ss.precision(3);
+		ss << std::scientific << v;
+		return ss.str();
+	}
+
+	void Encodings(Runner& Run, const Options& Opt) {
+		const size_t Width = Opt.Quick ? 128 : 512, Batch = 32;
+		InputLayer Input(Width);
+		NeuronLayer Dense0(&Input, Width, LayerActivation::ReLU);
+		NeuronLayer Dense1(&Dense0, Width, LayerActivation::ReLU);
+		NeuronLayer Dense2(&Dense1, 16, LayerActivation::Linear);
+		NetContainer Net(&Dense2);
+		auto Weights = Net.GetDNA().GetData();
+		std::vector<float> Decoded(Weights.size());
+		for (auto& st : Net.CompareEncodings(netData::Random(Width, Batch))) {
+			auto Data = EncodeWeights(Weights.data(), Weights.size(), st.Encoding);
+			Result r{ "encodings", EncodingName(st.Encoding), {
+				{ "weights", std::to_string(Weights.size()) },
+				{ "bytes", std::to_string(st.Bytes) },
+				{ "max_weight_error", Scientific(st.MaxWeightError) },
+				{ "output_rms_error", Scientific(st.OutputError) } } };
+			r.Items = double(Weights.size());
+			Run.Run(r, [&] { DecodeWeights(Data.data(), Data.size(), st.Encoding, Decoded.data(), Decoded.size()); });
+		}
+	}
+
+	Eigen::MatrixXf ClusterData(size_t Dim, size_t Count, size_t Clusters, uint64_t Seed) {
+		std::mt19937_64 gen(Seed);
+		std::normal_distribution<float> Normal;
+		Eigen::MatrixXf Centers(Dim, Clusters), Points(Dim, Count);
+		for (int64_t i = 0; i < Centers.size(); i++) Centers(i) = 10.0f * Normal(gen);
+		for (int64_t j = 0; j < Points.cols(); j++)
+			for (int64_t i = 0; i < Points.rows(); i++)
+				Points(i, j) = Centers(i, j % Clusters) + Normal(gen);
+		return Points;
+	}
+
+	double Inertia(const Eigen::MatrixXf& Points, const Eigen::MatrixXf& Centroids, const std::vector<int>& Labels) {
+		double ret = 0;
+		for (int64_t j = 0; j < Points.cols(); j++) ret += (Points.col(j) - Centroids.col(Labels[j])).squaredNorm();
+		return ret / Points.cols();
+	}
+
+	// The scalar kMean this library shipped before the matrix version, kept as the reference point
+	std::vector<std::vector<float>> ReferenceKMean(const std::vector<std::vector<float>>& vecs, size_t nClusters) {
+		auto vecSize = vecs[0].size();
+		auto dist2 = [](const std::vector<float>& a, const std::vector<float>& b) {
+			float dist = 0;
+			for (size_t i = 0; i < a.size(); i++) {
+				float sub = a[i] - b[i];
+				dist += sub * sub;
+			}
+			return dist;
+		};
+		std::default_random_engine gen;
+		std::uniform_int_distribution<int> rBool(0, 1);
+		std::vector<int> Cluster(vecs.size());
+		for (size_t i = 0; i < vecs.size(); i++) Cluster[i] = int(i);
+		std::partial_sort(Cluster.begin(), Cluster.begin() + nClusters, Cluster.end(), [&rBool, &gen](const auto& a, const auto& b) { return rBool(gen); });
+
+		std::vector<std::vector<float>> ret, tmp;
+		std::vector<size_t> Counts(nClusters);
+		for (size_t i = 0; i < nClusters; i++) {
+			ret.push_back(vecs[Cluster[i]]);
+			tmp.emplace_back(vecSize);
+		}
+		int notFinished = 1;
+		while (notFinished) {
+			notFinished = 0;
+			for (size_t i = 0; i < nClusters; i++) {
+				std::fill(tmp[i].begin(), tmp[i].end(), 0.0f);
+				Counts[i] = 0;
+			}
+			size_t cur = 0;
+			for (auto& vec : vecs) {
+				size_t min = 0;
+				float minDist = dist2(ret[0], vec);
+				for (size_t c = 1; c < nClusters; c++) {
+					float dist = dist2(ret[c], vec);
+					if (dist < minDist) { min = c; minDist = dist; }
+				}
+				notFinished |= int(min) != Cluster[cur];
+				Cluster[cur++] = int(min);
+				for (size_t j = 0; j < vecSize; j++) tmp[min][j] += vec[j];
+				Counts[min]++;
+			}
+			for (size_t i = 0; i < nClusters; i++) {
+				float inv = 1.0f / Counts[i];
+				for (size_t j = 0; j < vecSize; j++) ret[i][j] = tmp[i][j] * inv;
+			}
+		}
+		return ret;
+	}
+
+	void kMeans(Runner& Run, const Options& Opt) {
+		const size_t Dim = Opt.Quick ? 16 : 32, Count = Opt.Quick ? 10000 : 100000, Clusters = Opt.Quick ? 16 : 64, BatchSize = 2048;
+		auto Points = ClusterData(Dim, Count, Clusters, 1);
+		auto Params = [&](std::vector<std::pair<std::string, std::string>> Extra) {
+			std::vector<std::pair<std::string, std::string>> ret{ { "points", std::to_string(Count) }, { "dim", std::to_string(Dim) }, { "clusters", std::to_string(Clusters) } };
+			ret.insert(ret.end(), Extra.begin(), Extra.end());
+			return ret;
+		};
+
+		std::vector<std::vector<float>> Vectors(Count);
+		for (size_t j = 0; j < Count; j++) Vectors[j].assign(Points.col(j).data(), Points.col(j).data() + Dim);
+		auto Reference = ReferenceKMean(Vectors, Clusters);
+		Eigen::MatrixXf RefCentroids(Dim, Clusters);
+		for (size_t k = 0; k < Clusters; k++) RefCentroids.col(k) = Eigen::Map<const Eigen::VectorXf>(Reference[k].data(), Dim);
+		std::vector<int> RefLabels(Count);
+		for (size_t j = 0; j < Count; j++) (RefCentroids.colwise() - Points.col(j)).colwise().squaredNorm().minCoeff(&RefLabels[j]);
+		Result Ref{ "kmean", "reference", Params({ { "init", "random" }, { "inertia", std::to_string(Inertia(Points, RefCentroids, RefLabels)) } }) };
+		Ref.Items = double(Count);
+		const double Baseline = Run.Run(Ref, [&] { ReferenceKMean(Vectors, Clusters); });
+
+		for (auto Init : { PVX::Solvers::kMeanInit::Random, PVX::Solvers::kMeanInit::PlusPlus }) {
+			for (bool Accelerated : { false, true }) {
+				PVX::Solvers::kMeanOptions o;
+				o.Init = Init;
+				o.Accelerated = Accelerated;
+				o.Threads = Opt.Threads;
+				auto Check = PVX::Solvers::kMean(Points, Clusters, o);
+				Result r{ "kmean", Accelerated ? "hamerly" : "lloyd", Params({
+					{ "init", Init == PVX::Solvers::kMeanInit::PlusPlus ? "plusplus" : "random" },
+					{ "iterations", std::to_string(Check.Iterations) },
+					{ "inertia", std::to_string(Check.Inertia / Count) } }) };
+				r.Items = double(Count);
+				r.Baseline = Baseline;
+				Run.Run(r, [&] { PVX::Solvers::kMean(Points, Clusters, o); });
+			}
+		}
+		auto MiniBatch = [&] {
+			PVX::Solvers::kMeanMiniBatch mb(Clusters, 0, Opt.Threads);
+			for (int Epoch = 0; Epoch < 3; Epoch++)
+				for (size_t Start = 0; Start < Count; Start += BatchSize)
+					mb.Update(Points.middleCols(Start, std::min(BatchSize, Count - Start)));
+			return mb;
+		};
+		auto mb = MiniBatch();
+		Result r{ "kmean", "minibatch", Params({ { "batch", std::to_string(BatchSize) }, { "epochs", "3" }, { "inertia", std::to_string(Inertia(Points, mb.GetCentroids(), mb.Predict(Points))) } }) };
+		r.Items = 3.0 * Count;
+		r.Baseline = Baseline;
+		Run.Run(r, [&] { MiniBatch(); });
+	}
+
+	void Usage() {
+		std::cerr <<
+			"PVX_Benchmark [options]\n"
+			"  --filter <text>     run only benchmarks whose group/name contains text\n"
+			"  --min-time <sec>    minimum time per measured sample (default 0.1)\n"
+			"  --repetitions <n>   samples per benchmark (default 5)\n"
+			"  --threads <n>       Eigen threads (default hardware concurrency)\n"
+			"  --quick             smaller sweep\n"
+			"  --out <file>        write JSON to file instead of stdout\n";
+	}
+}
+
+int main(int argc, char** argv) {
+	Options Opt;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		auto Next = [&]() -> std::string {
+			if (i + 1 >= argc) { Usage(); exit(1); }
+			return argv[++i];
+		};
+		if (a == "--filter") Opt.Filter = Next();
+		else if (a == "--min-time") Opt.MinTime = std::stod(Next());
+		else if (a == "--repetitions") Opt.Repetitions = std::max(1, std::stoi(Next()));
+		else if (a == "--threads") Opt.Threads = std::stoi(Next());
+		else if (a == "--quick") Opt.Quick = 1;
+		else if (a == "--out") Opt.Output = Next();
+		else { Usage(); return a == "--help" ? 0 : 1; }
+	}
+
+	// The first NeuronLayer runs a one-time Eigen::setNbThreads(8); trigger it now so it cannot override --threads
+	{
+		InputLayer Init(1);
+		NeuronLayer Setup(&Init, 1);
+	}
+	Eigen::setNbThreads(Opt.Threads > 0 ? Opt.Threads : std::max(1, int(std::thread::hardware_concurrency())));
+
+	Runner Run(Opt);
+	DenseLayers(Run, Opt);
+	ActivationLayers(Run, Opt);
+	TrainSchemes(Run, Opt);
+	FanIn<NeuronAdder>(Run, Opt, "adder");
+	FanIn<NeuronCombiner>(Run, Opt, "combiner");
+	Population(Run, Opt);
+	Encodings(Run, Opt);
+	kMeans(Run, Opt);
+
+	if (Opt.Output.size()) {
+		std::ofstream out(Opt.Output);
+		Run.Write(out);
+	} else {
+		Run.Write(std::cout);
+	}
+	return 0;
+}
@@ -6,19 +6,46 @@
 #include<stdio.h>
 #include<map>
 #include<functional>
+#include<stdint.h>
+#include<memory>
+#include<iosfwd>
+#include<string.h>
 
 namespace PVX {
+	typedef struct BinIndexEntry {
+		union {
+			unsigned int iName;
+			char sName[4];
+		};
+		unsigned int Parent;
+		uint64_t Offset;
+		uint64_t Size;
+	}BinIndexEntry;
+
 	class BinSaver {
-		std::vector<long> SizePos;
-		FILE* fout;
+		std::vector<unsigned char> Buffer;
+		std::vector<size_t> SizePos;
+		std::vector<size_t> OpenEntries;
+		std::vector<BinIndexEntry> Entries;
+		int WriteIndex = 0;
+		int SyncOnSave = 0;
+		FILE* fout = nullptr;
+		std::vector<unsigned char>* Target = nullptr;
+		std::ostream* Stream = nullptr;
 	public:
 		BinSaver(const char* Filename, const char* head);
 		BinSaver(const wchar_t* Filename, const char* head);
 		BinSaver(const std::string& Filename);
 		BinSaver(const char* Filename);
+		BinSaver(std::vector<unsigned char>& Output, const char* head);
+		BinSaver(std::ostream& Output, const char* head);
 		~BinSaver();
-		void Begin(const char* Name);
+		void Begin(const char* Name, int Wide = 0);
+		void Wide();
 		void End();
+		void Align(size_t Alignment, int Wide = 0);
+		void Indexed(int Enable = 1);
+		void Sync(int Enable = 1);
 		int Save();
 		size_t write(const void* buffer, size_t size, size_t count);
 		size_t write(const std::vector<unsigned char>& Bytes);
@@ -41,7 +68,7 @@ namespace PVX {
 		template<typename T>
 		inline size_t Write(const char* Name, const T* Array, size_t Count) {
 			size_t ret;
-			Begin(Name);
+			Begin(Name, sizeof(T) * Count >= ~0u);
 			{
 				ret = write(Array, sizeof(T), Count);
 			} End();
@@ -51,7 +78,7 @@ namespace PVX {
 		template<typename T>
 		inline size_t Write(const char* Name, const std::vector<T>& v) {
 			size_t ret;
-			Begin(Name);
+			Begin(Name, sizeof(T) * v.size() >= ~0u);
 			{
 				ret = write(&v[0], sizeof(T), v.size());
 			} End();
@@ -68,6 +95,24 @@ namespace PVX {
 		}
 	};
 
+	int RenameFile(const wchar_t* From, const wchar_t* To);
+	int Seek64(FILE* f, int64_t Offset, int Origin);
+	int64_t Tell64(FILE* f);
+
+	class BinMapping {
+		void* Handle = nullptr;
+		char* Data = nullptr;
+		size_t Size = 0;
+	public:
+		BinMapping(const wchar_t* Filename);
+		~BinMapping();
+		BinMapping(const BinMapping&) = delete;
+		BinMapping& operator=(const BinMapping&) = delete;
+		const char* data() const { return Data; }
+		size_t size() const { return Size; }
+		int OK() const { return Data != nullptr; }
+	};
+
 	typedef struct BinHeader {
 		union {
 			unsigned int iName;
@@ -78,16 +123,31 @@ namespace PVX {
 
 #define TAG(x,y,z,w) (w<<24|z<<16|y<<8|x)
 
+	class BinSource {
+	public:
+		virtual ~BinSource() = default;
+		virtual size_t Read(void* Data, size_t Size) = 0;
+		virtual int Seek(int64_t Offset, int Origin) = 0;
+		virtual int64_t Tell() = 0;
+	};
+
 	class BinLoader {
 	private:
-		FILE* fin;
+		BinSource* fin = nullptr;
+		std::unique_ptr<BinSource> Source;
 		size_t cur;
 		size_t Size;
+		size_t Start = 0;
 		BinLoader* Parent;
+		int ReadHeader(BinHeader& hd, size_t& sz);
 		std::map<unsigned int, std::function<void(BinLoader& bin)>> Loader;
 		std::function<void(BinLoader& bin, const char*)> AnyLoader = nullptr;
-		BinLoader(FILE* fin, size_t Size, BinLoader* Parent);
+		BinLoader(BinSource* fin, size_t Size, BinLoader* Parent);
+		void Open(const char* header);
 	public:
+		BinLoader(std::unique_ptr<BinSource> Source, const char* header);
+		BinLoader(const void* Data, size_t Size, const char* header);
+		BinLoader(std::istream& Stream, const char* header);
 		BinLoader(const char* fn, const char* header);
 		BinLoader(const wchar_t* fn, const char* header);
 		BinLoader(const std::string& fn);
@@ -113,6 +173,10 @@ namespace PVX {
 		void Execute();
 		int OK();
 		size_t Remaining(int ItemSize = 1);
+		size_t Position();
+		void Skip();
+		std::vector<BinIndexEntry> ReadIndex();
+		void Seek(const BinIndexEntry& Entry, std::function<void(BinLoader&)> Loader);
 
 		void ReadBytes(std::vector<unsigned char>& Bytes, size_t size = 0);
 
@@ -3,13 +3,21 @@
 
 #define EIGEN_MPL2_ONLY
 
-#include <../eigen-eigen-323c052e1731/Eigen/dense>
+#include <../eigen-eigen-323c052e1731/Eigen/Dense>
 #include <vector>
 #include <PVX_BinSaver.h>
 #include <string>
 #include <random>
 #include <set>
 #include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <atomic>
 
 namespace PVX {
 	namespace DeepNeuralNets {
@@ -24,6 +32,25 @@ namespace PVX {
 			Linear
 		};
 
+		enum class WeightEncoding {
+			Float32,
+			Float16,
+			BFloat16,
+			ShuffleLZ
+		};
+
+		std::vector<unsigned char> EncodeWeights(const float* Weights, size_t Count, WeightEncoding Encoding);
+		void DecodeWeights(const unsigned char* Data, size_t Size, WeightEncoding Encoding, float* Weights, size_t Count);
+
+		class InferenceSession;
+		class ProfileScope;
+
+		enum class ProfileStage {
+			FeedForward,
+			BackPropagate,
+			UpdateWeights
+		};
+
 		struct WeightData {
 			size_t Offset;
 			size_t Count;
@@ -39,7 +66,9 @@ namespace PVX {
 			int64_t FeedVersion = -1;
 			int64_t FeedIndexVersion = -1;
 			static int OverrideOnLoad;
-			static size_t NextId;
+			static WeightEncoding SaveEncoding;
+			static std::atomic<size_t> NextId;
+			static int Profiling;
 			static float
 				__LearnRate,
 				__Momentum,
@@ -58,6 +87,14 @@ namespace PVX {
 			friend class OutputLayer;
 			friend class NeuralNetContainer;
 			friend class NetContainer;
+			friend class InferenceSession;
+			friend class ProfileScope;
+
+			struct ProfileCounter {
+				size_t Calls = 0, Columns = 0;
+				double Seconds = 0, Flops = 0, Bytes = 0;
+			} Profile[3];
+			virtual void Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const;
 			
 			virtual void Save(PVX::BinSaver& bin, const std::map<NeuralLayer_Base*, size_t>& IndexOf) const = 0;
 
@@ -77,6 +114,8 @@ namespace PVX {
 			virtual void BackPropagate(const netData& Gradient, int64_t Index) = 0;
 			virtual size_t nInput() const = 0;
 			virtual void UpdateWeights() = 0;
+			virtual void Infer(InferenceSession& s) const = 0;
+			virtual void Infer(InferenceSession& s, int64_t Index) const = 0;
 
 			size_t nOutput() const;
 			netData Output();
@@ -97,6 +136,8 @@ namespace PVX {
 			static void Dropout(float Rate);
 			static void UseDropout(int);
 			static void OverrideParamsOnLoad(int ovrd = 1);
+			static void SaveWeightsAs(WeightEncoding Encoding);
+			static void EnableProfiling(int Enable = 1);
 			
 			virtual void SetLearnRate(float a);
 			virtual void SetRMSprop(float Beta);
@@ -124,6 +165,8 @@ namespace PVX {
 			void BackPropagate(const netData & Gradient) {}
 			void BackPropagate(const netData& Gradient, int64_t Index) {};
 			void UpdateWeights() {};
+			void Infer(InferenceSession&) const {}
+			void Infer(InferenceSession&, int64_t) const {}
 			size_t nInput() const;
 
 			void InputRaw(const netData & Data);
@@ -170,9 +213,16 @@ namespace PVX {
 			void(NeuronLayer::*updateWeights)(const netData & Gradient);
 			TrainScheme training;
 			LayerActivation activation;
+			const float* WeightView = nullptr;
+			int64_t ViewCols = 0;
+
+			NeuronLayer(size_t nInput, size_t nOutput, LayerActivation Activate, TrainScheme Train, const float* View);
+			float Setup(size_t nInput, size_t nOutput);
+			Eigen::Map<const netData> WeightsView() const;
+			void Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const;
 
 			void Save(PVX::BinSaver& bin, const std::map<NeuralLayer_Base*, size_t>& IndexOf) const;
-			static NeuralLayer_Base* Load2(PVX::BinLoader& bin);
+			static NeuralLayer_Base* Load2(PVX::BinLoader& bin, const char* Mapped = nullptr);
 			NeuralLayer_Base* newCopy(const std::map<NeuralLayer_Base*,size_t>& IndexOf);
 							
 			float
@@ -196,6 +246,8 @@ namespace PVX {
 			void BackPropagate(const netData& Gradient);
 			void BackPropagate(const netData & Gradient, int64_t Index);
 			void UpdateWeights();
+			void Infer(InferenceSession& s) const;
+			void Infer(InferenceSession& s, int64_t Index) const;
 
 			size_t DNA(std::map<void*, WeightData> & Weights);
 			void SetLearnRate(float a);
@@ -216,6 +268,7 @@ namespace PVX {
 
 			void Save(PVX::BinSaver& bin, const std::map<NeuralLayer_Base*, size_t>& IndexOf) const;
 			static ActivationLayer* Load2(PVX::BinLoader & bin);
+			void Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const;
 			NeuralLayer_Base* newCopy(const std::map<NeuralLayer_Base*,size_t>& IndexOf);
 		public:
 			ActivationLayer(NeuralLayer_Base* inp, LayerActivation Activation = LayerActivation::ReLU);
@@ -228,6 +281,8 @@ namespace PVX {
 			void BackPropagate(const netData& Gradient);
 			void BackPropagate(const netData& Gradient, int64_t Index);
 			void UpdateWeights();
+			void Infer(InferenceSession& s) const;
+			void Infer(InferenceSession& s, int64_t Index) const;
 			size_t DNA(std::map<void*, WeightData>& Weights);
 
 			size_t nInput() const;
@@ -239,6 +294,7 @@ namespace PVX {
 			friend class NetContainer;
 			void Save(PVX::BinSaver& bin, const std::map<NeuralLayer_Base*, size_t>& IndexOf) const;
 			static NeuronAdder* Load2(PVX::BinLoader& bin);
+			void Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const;
 			NeuralLayer_Base* newCopy(const std::map<NeuralLayer_Base*,size_t>& IndexOf);
 		public:
 			NeuronAdder(const size_t InputSize);
@@ -251,6 +307,8 @@ namespace PVX {
 			void BackPropagate(const netData & Gradient);
 			void BackPropagate(const netData& Gradient, int64_t Index);
 			void UpdateWeights();
+			void Infer(InferenceSession& s) const;
+			void Infer(InferenceSession& s, int64_t Index) const;
 			size_t nInput() const;
 		};
 
@@ -260,6 +318,7 @@ namespace PVX {
 			friend class NetContainer;
 			void Save(PVX::BinSaver& bin, const std::map<NeuralLayer_Base*, size_t>& IndexOf) const;
 			static NeuronMultiplier* Load2(PVX::BinLoader& bin);
+			void Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const;
 			NeuralLayer_Base* newCopy(const std::map<NeuralLayer_Base*,size_t>& IndexOf);
 		public:
 			NeuronMultiplier(const size_t inputs);
@@ -270,6 +329,8 @@ namespace PVX {
 			void BackPropagate(const netData & Gradient);
 			void BackPropagate(const netData& Gradient, int64_t Index);
 			void UpdateWeights();
+			void Infer(InferenceSession& s) const;
+			void Infer(InferenceSession& s, int64_t Index) const;
 			size_t nInput() const;
 		};
 
@@ -289,6 +350,8 @@ namespace PVX {
 			void BackPropagate(const netData& Gradient);
 			void BackPropagate(const netData& Gradient, int64_t Index);
 			void UpdateWeights();
+			void Infer(InferenceSession& s) const;
+			void Infer(InferenceSession& s, int64_t Index) const;
 			size_t nInput() const;
 		};
 
@@ -320,6 +383,8 @@ namespace PVX {
 			void BackPropagate(const netData&, int64_t);
 			size_t nInput() const;
 			void UpdateWeights();
+			void Infer(InferenceSession& s) const;
+			void Infer(InferenceSession& s, int64_t Index) const;
 		};
 
 		class RecurrentLayer : public NeuralLayer_Base {
@@ -341,6 +406,8 @@ namespace PVX {
 			void BackPropagate(const netData&, int64_t);
 			size_t nInput() const;
 			void UpdateWeights();
+			void Infer(InferenceSession& s) const;
+			void Infer(InferenceSession& s, int64_t Index) const;
 
 			void Reset();
 		};
@@ -351,6 +418,8 @@ namespace PVX {
 			friend class NeuralNetOutput_Base; 
 			friend class OutputLayer;
 			friend class NetContainer;
+			friend class CheckpointRing;
+			friend class PopulationEvaluator;
 		public:
 			void GetData(std::vector<float>& Data);
 			std::vector<float> GetData();
@@ -432,6 +501,8 @@ namespace PVX {
 
 		class NetContainer {
 		protected:
+			std::shared_ptr<PVX::BinMapping> Mapping;
+			static NeuralLayer_Base* LoadLayer(unsigned int Tag, PVX::BinLoader& bin, const char* Mapped);
 			std::vector<NeuralLayer_Base*> OwnedLayers;
 			std::vector<InputLayer*> Inputs;
 			std::vector<NeuronLayer*> DenseLayers;
@@ -443,6 +514,7 @@ namespace PVX {
 			NetDNA Checkpoint;
 			float CheckpointError = -1.0f;
 			std::vector<float> CheckpointDNA;
+			int ReadOnly = 0;
 
 			std::vector<netData> AllInputData;
 			netData AllTrainData;
@@ -458,18 +530,39 @@ namespace PVX {
 			float GetError_SoftMax(const netData& Data);
 			float Train_SoftMax(const netData& Data);
 
+			static void OutputMeanSquare(const netData& Last, netData& Output);
+			static void OutputSoftMax(const netData& Last, netData& Output);
+			static void OutputStableSoftMax(const netData& Last, netData& Output);
+
 			std::function<void()> FeedForward;
 			std::function<float(const netData&)> GetErrorFnc;
 			std::function<float(const netData&)> TrainFnc;
 			std::vector<RecurrentLayer*> RNNs;
 			float error = -1.0f;
 			void Init();
+			void Save(PVX::BinSaver& bin, int OptimizerState);
+			void Load(PVX::BinLoader& bin, std::function<std::unique_ptr<PVX::BinLoader>()> Reopen, const char* Mapped);
+			void BuildFlat(std::vector<unsigned char>& Output, std::vector<const float*>* DenseWeights);
+			friend class InferenceSession;
+			friend class PopulationEvaluator;
+			friend class InferenceQueue;
+			friend class AsyncEvaluator;
+			friend class AsyncCheckpoint;
+			friend class CheckpointRing;
 		public:
 			NetContainer(NeuralLayer_Base* Last, OutputType Type = OutputType::MeanSquare);
 			NetContainer(const std::wstring& Filename);
+			NetContainer(const std::wstring& Filename, int MapWeights);
+			// With MapWeights the layers read their weights from Data, which must outlive this container and its copies
+			NetContainer(const unsigned char* Data, size_t Size, int MapWeights = 0);
+			NetContainer(std::istream& Stream);
+			NetContainer(const NetContainer& net);
 			~NetContainer();
 
 			void Save(const std::wstring& Filename);
+			void Save(const std::wstring& Filename, int OptimizerState);
+			void Save(std::vector<unsigned char>& Output, int OptimizerState = 0);
+			void Save(std::ostream& Output, int OptimizerState = 0);
 			NetDNA GetDNA();
 			void SaveCheckpoint();
 			float LoadCheckpoint();
@@ -519,6 +612,293 @@ namespace PVX {
 
 			void SetBatchSize(int sz);
 			float Iterate();
+			void CopyWeightsFrom(const NetContainer& from);
+			void CopyStateFrom(const NetContainer& from);
+
+			struct EncodingStats {
+				WeightEncoding Encoding;
+				size_t Bytes;
+				float MaxWeightError;
+				float OutputError;
+			};
+			std::vector<EncodingStats> CompareEncodings(const netData& Input);
+
+			struct LayerProfile {
+				std::string Name;
+				size_t Id;
+				ProfileStage Stage;
+				size_t Calls, Columns;
+				double Seconds, Flops, Bytes, GFlops, Share;
+			};
+			// Train only calls UpdateWeights on the last layer and NeuronLayer does not recurse, so UpdateWeights rows cover the last dense layer alone
+			std::vector<LayerProfile> Profile() const;
+			void ResetProfile();
+
+			void ExportFlat(std::vector<unsigned char>& Output);
+			void ExportFlat(const std::wstring& Filename);
+		};
+
+		class InferenceSession {
+		public:
+			struct LayerState {
+				netData output;
+				netData Hidden;
+				int64_t FeedVersion = -1;
+				int64_t FeedIndexVersion = -1;
+			};
+		protected:
+			const NetContainer& Net;
+			std::map<const NeuralLayer_Base*, LayerState> States;
+			std::vector<LayerState*> Inputs;
+			std::vector<LayerState*> Recurrent;
+			int64_t Version = 0;
+			int StepMode = 0;
+			netData output;
+			void FeedForward();
+		public:
+			InferenceSession(const NetContainer& Net);
+			LayerState& State(const NeuralLayer_Base* Layer) { return States.at(Layer); }
+			int64_t CurrentVersion() const { return Version; }
+			int Stepping() const { return StepMode; }
+
+			void ResetRNN();
+
+			std::vector<float> ProcessVec(const std::vector<float>& Inp);
+
+			const netData& Process(const netData& inp);
+			const netData& Process(const std::vector<netData>& inp);
+			const netData& ProcessRaw(const netData& inp);
+			const netData& ProcessRaw(const std::vector<netData>& inp);
+		};
+
+		class RecurrentStream : protected InferenceSession {
+		protected:
+			std::vector<size_t> Offsets;
+			size_t StateSize = 0;
+			netData Pool;
+			std::vector<size_t> FreeHandles;
+			std::vector<unsigned char> Opened;
+			void Check(size_t Handle) const;
+			void Gather(const std::vector<size_t>& Handles);
+			void Scatter(const std::vector<size_t>& Handles);
+		public:
+			RecurrentStream(const NetContainer& Net);
+
+			size_t Open();
+			void Close(size_t Handle);
+			void Reset(size_t Handle);
+			std::vector<float> Snapshot(size_t Handle) const;
+			void Restore(size_t Handle, const std::vector<float>& State);
+
+			const netData& Step(const std::vector<size_t>& Handles, const netData& inp);
+			const netData& StepRaw(const std::vector<size_t>& Handles, const netData& inp);
+		};
+
+		class AsyncEvaluator {
+		protected:
+			struct Job {
+				NetContainer* Replica;
+				int64_t Step;
+			};
+			NetContainer& Net;
+			netData Input, Output;
+			size_t BatchSize;
+			std::function<void(float Error, int64_t Step)> OnResult;
+
+			std::vector<std::unique_ptr<NetContainer>> Replicas;
+			std::vector<NetContainer*> Idle;
+			std::deque<Job> Jobs;
+			std::unique_ptr<NetContainer> Best, Saving;
+			float bestError = -1.0f;
+			int64_t bestStep = -1;
+			std::wstring BestFilename;
+			int64_t BestVersion = 0, SavedVersion = 0;
+
+			std::mutex Lock, SaveLock, ResultLock;
+			std::condition_variable Signal, IdleSignal;
+			bool Running = true;
+			std::vector<std::thread> Workers;
+			void Run();
+			void SaveBest();
+		public:
+			AsyncEvaluator(NetContainer& Net, const netData& Input, const netData& Output, std::function<void(float Error, int64_t Step)> OnResult = nullptr, size_t Threads = 1, size_t BatchSize = 1024);
+			~AsyncEvaluator();
+
+			void KeepBest(const std::wstring& Filename);
+			void Evaluate(int64_t Step);
+			void Wait();
+
+			float BestError();
+			int64_t BestStep();
+			void RestoreBest();
+		};
+
+		class AsyncCheckpoint {
+		protected:
+			NetContainer& Net;
+			std::function<void(const std::wstring& Filename, int64_t Step, int Success)> OnSaved;
+			std::unique_ptr<NetContainer> Slots[2];
+			int Pending = -1, Writing = -1;
+			std::wstring PendingFilename;
+			int64_t PendingStep = 0;
+
+			std::mutex Lock;
+			std::condition_variable Signal, IdleSignal;
+			bool Running = true;
+			std::thread Worker;
+			void Run();
+		public:
+			AsyncCheckpoint(NetContainer& Net, std::function<void(const std::wstring& Filename, int64_t Step, int Success)> OnSaved = nullptr);
+			~AsyncCheckpoint();
+
+			void Save(const std::wstring& Filename, int64_t Step = 0);
+			void Wait();
+		};
+
+		class CheckpointRing {
+		protected:
+			struct Snapshot {
+				int64_t Step;
+				float Error;
+				int Keyframe;
+				std::vector<unsigned char> Data;
+			};
+			NetContainer& Net;
+			NetDNA DNA;
+			size_t Capacity, KeyframeInterval;
+			std::deque<Snapshot> Ring;
+			std::vector<float> Latest, Scratch;
+			void Decode(size_t Index, std::vector<float>& Out) const;
+		public:
+			CheckpointRing(NetContainer& Net, size_t Capacity = 20, size_t KeyframeInterval = 8);
+
+			void Save(int64_t Step = 0);
+			void Restore(size_t Back = 0);
+			size_t Size() const;
+			int64_t Step(size_t Back = 0) const;
+			float Error(size_t Back = 0) const;
+			size_t MemoryUsage() const;
+		};
+
+		class FlatNet {
+		protected:
+			friend class NetContainer;
+			friend class PopulationEvaluator;
+			enum class OpType : uint32_t {
+				Input,
+				Dense,
+				Activation,
+				Adder,
+				Multiplier,
+				Combiner
+			};
+			struct Header {
+				uint32_t Magic;
+				uint32_t Version;
+				uint32_t OpCount;
+				uint32_t InputCount;
+				uint32_t Output;
+				uint32_t Reserved;
+				uint64_t OpsOffset;
+				uint64_t InputsOffset;
+				uint64_t WeightsOffset;
+				uint64_t WeightCount;
+				uint64_t ArenaRows;
+				uint64_t TotalSize;
+			};
+			struct Op {
+				OpType Type;
+				uint32_t Activation;
+				uint32_t Rows;
+				uint32_t InputCount;
+				uint32_t InputStart;
+				uint32_t WeightCols;
+				uint64_t WeightOffset;
+				uint64_t ArenaOffset;
+			};
+			std::vector<unsigned char> Owned;
+			std::shared_ptr<PVX::BinMapping> Mapping;
+			const Header* header = nullptr;
+			const Op* Ops = nullptr;
+			const uint32_t* OpInputs = nullptr;
+			const float* Weights = nullptr;
+			std::vector<const Op*> InputOps;
+			std::vector<float> Arena;
+			int64_t Batch = 0;
+			netData output;
+
+			void Bind(const unsigned char* Data, size_t Size);
+			Eigen::Map<netData> Buffer(const Op& o);
+			void Resize(int64_t Cols);
+			void Run();
+		public:
+			FlatNet(const std::wstring& Filename, int MapWeights = 1);
+			FlatNet(const unsigned char* Data, size_t Size);
+
+			const netData& Process(const netData& inp);
+			const netData& Process(const std::vector<netData>& inp);
+			std::vector<float> ProcessVec(const std::vector<float>& Inp);
+			size_t nInput(size_t Index = 0) const;
+			size_t nOutput() const;
+		};
+
+		class PopulationEvaluator {
+		protected:
+			std::vector<unsigned char> Blob;
+			std::unique_ptr<FlatNet> Net;
+			std::vector<uint64_t> DNAOffset;
+			std::vector<char> Shared, Stacked;
+			std::vector<netData> Buffers, output;
+			netData StackedWeights, StackedOutput;
+			size_t DNALength;
+			int Threads;
+			int64_t Batch = 0, Population = 0;
+			void Resize(int64_t Population, int64_t Batch);
+			void RunOp(size_t Index, int64_t Candidate, const float* DNA);
+		public:
+			PopulationEvaluator(NetContainer& Net, int Threads = 0);
+			size_t DNASize() const { return DNALength; }
+			const std::vector<netData>& Process(const std::vector<const float*>& Candidates, const netData& Input);
+			const std::vector<netData>& Process(const std::vector<const float*>& Candidates, const std::vector<netData>& Inputs);
+			std::vector<float> Error(const std::vector<const float*>& Candidates, const netData& Input, const netData& Target);
+			std::vector<float> Error(const std::vector<const float*>& Candidates, const std::vector<netData>& Inputs, const netData& Target);
+		};
+
+		class InferenceQueue {
+		public:
+			struct LatencyStats {
+				float QueueP50, QueueP99;
+				float ComputeP50, ComputeP99;
+				size_t Requests, Batches;
+			};
+		protected:
+			struct Request {
+				std::vector<float> Input;
+				std::promise<std::vector<float>> Result;
+				std::chrono::steady_clock::time_point Enqueued;
+			};
+			InferenceSession Session;
+			size_t MaxBatch;
+			std::chrono::microseconds MaxWait;
+			size_t nInput;
+
+			std::deque<Request> Pending;
+			std::mutex Lock;
+			std::condition_variable Signal;
+			bool Running = true;
+
+			std::mutex StatsLock;
+			std::vector<float> QueueTimes, ComputeTimes;
+			size_t Requests = 0, Batches = 0;
+
+			std::thread Worker;
+			void Run();
+		public:
+			InferenceQueue(const NetContainer& Net, size_t MaxBatch = 64, std::chrono::microseconds MaxWait = std::chrono::microseconds(2000));
+			~InferenceQueue();
+
+			std::future<std::vector<float>> Process(const std::vector<float>& Input);
+			LatencyStats Stats();
 		};
 
 		class NeuralNetContainer {
@@ -1,16 +1,33 @@
+#include <../eigen-eigen-323c052e1731/Eigen/Dense>
 #include <functional>
 #include <vector>
 #include <random>
+#include <thread>
+#include <atomic>
+#include <memory>
 
 namespace PVX {
 	namespace Solvers {
+		struct ModelReplica {
+			std::function<float()> ErrorFunction;
+			std::vector<std::pair<float*, size_t>> Model;
+		};
+
 		class GradientDescent {
+		public:
+			using Replica = ModelReplica;
+		protected:
 			float LearnRate, Momentum, RMSprop, iRMSprop;
 			std::function<float()> ErrorFnc;
 			std::vector<std::pair<float*, size_t>> Updater;
-			std::vector<float> vRMSprop, vMomentum, vGradient, SavePoint;
+			std::vector<float> vRMSprop, vMomentum, vGradient, SavePoint, Current;
+			std::vector<Replica> Replicas;
 			size_t ModelSize;
 			float Error, LastError;
+			virtual void Gradient(float dx);
+			void RunWorkers(const std::function<void(size_t, std::function<float()>&, std::vector<std::pair<float*, size_t>>&)>& Task);
+			GradientDescent(Replica Master, float LearnRate, float Momentum, float RMSprop) :
+				GradientDescent(Master.ErrorFunction, Master.Model, LearnRate, Momentum, RMSprop) {}
 		public:
 			GradientDescent(
 				std::function<float()> ErrorFunction,
@@ -22,13 +39,80 @@ namespace PVX {
 				float* Model, size_t ModelSize,
 				float LearnRate = 1e-5f, float Momentum = 0.9999f, float RMSprop = 0.9999f
 			);
+			GradientDescent(
+				std::function<Replica()> MakeReplica, int Threads = 0,
+				float LearnRate = 1e-5f, float Momentum = 0.9999f, float RMSprop = 0.9999f
+			);
+			virtual ~GradientDescent() = default;
 			float Iterate(float dx = 1e-5f);
 			void RecalculateError();
 			void ClearMomentum();
 		};
 
+		class SPSA : public GradientDescent {
+		protected:
+			int Draws;
+			uint64_t Seed, Step = 0;
+			std::vector<std::vector<float>> Accum;
+			std::vector<std::vector<signed char>> Signs;
+			void Gradient(float dx) override;
+		public:
+			SPSA(
+				std::function<float()> ErrorFunction,
+				std::vector<std::pair<float*, size_t>> Model,
+				int Draws = 1,
+				float LearnRate = 1e-5f, float Momentum = 0.9999f, float RMSprop = 0.9999f,
+				uint64_t Seed = 5489
+			);
+			SPSA(
+				std::function<float()> ErrorFunction,
+				float* Model, size_t ModelSize,
+				int Draws = 1,
+				float LearnRate = 1e-5f, float Momentum = 0.9999f, float RMSprop = 0.9999f,
+				uint64_t Seed = 5489
+			);
+			SPSA(
+				std::function<Replica()> MakeReplica, int Draws, int Threads = 0,
+				float LearnRate = 1e-5f, float Momentum = 0.9999f, float RMSprop = 0.9999f,
+				uint64_t Seed = 5489
+			);
+		};
+
+		class EvolutionStrategies : public GradientDescent {
+		protected:
+			int Pairs;
+			uint64_t Seed, Step = 0;
+			std::shared_ptr<const std::vector<float>> Noise;
+			std::vector<size_t> Offsets;
+			std::vector<float> Errors;
+			std::vector<std::pair<float, int>> Ranks;
+			void Gradient(float Sigma) override;
+		public:
+			EvolutionStrategies(
+				std::function<float()> ErrorFunction,
+				std::vector<std::pair<float*, size_t>> Model,
+				int Pairs = 16,
+				float LearnRate = 1e-3f, float Momentum = 0.9f, float RMSprop = 0.999f,
+				size_t NoiseSize = 0, uint64_t Seed = 5489
+			);
+			EvolutionStrategies(
+				std::function<float()> ErrorFunction,
+				float* Model, size_t ModelSize,
+				int Pairs = 16,
+				float LearnRate = 1e-3f, float Momentum = 0.9f, float RMSprop = 0.999f,
+				size_t NoiseSize = 0, uint64_t Seed = 5489
+			);
+			EvolutionStrategies(
+				std::function<Replica()> MakeReplica, int Pairs, int Threads = 0,
+				float LearnRate = 1e-3f, float Momentum = 0.9f, float RMSprop = 0.999f,
+				size_t NoiseSize = 0, uint64_t Seed = 5489
+			);
+			static std::shared_ptr<const std::vector<float>> NoiseTable(size_t Size, uint64_t Seed);
+		};
+
 		class GeneticSolver {
 		protected:
+			friend class IslandSolver;
 			struct ErrorData {
 				float Error;
 				float* Model;
@@ -41,13 +125,16 @@ namespace PVX {
 			std::vector<float> Memory;
 			std::vector<ErrorData> Generation, Survived;
 
-			std::default_random_engine gen;
-			std::uniform_real_distribution<double> dist;
-			std::uniform_real_distribution<float> dist01;
-			std::uniform_int_distribution<int> intDist;
 			int curIter;
+			uint64_t Seed = 0, Epoch = 0;
 			void NextGeneration();
+			void MakeChild(int Index);
+			void NewGenerationEvents();
+			void SelectSurvivors();
 			std::vector<std::pair<float*, size_t>> Updater;
+			std::vector<ModelReplica> Replicas;
+			GeneticSolver(ModelReplica Master, int Population, int Survive, float MutationVariance, float MutateProbability, float Combine) :
+				GeneticSolver(Master.ErrorFunction, Master.Model, Population, Survive, MutationVariance, MutateProbability, Combine) {}
 
 			std::vector<std::function<float()>> NewGenEvent;
 		public:
@@ -69,14 +156,28 @@ namespace PVX {
 				float MutateProbability = 0.1f,
 				float Combine = 0.5f);
 
+			GeneticSolver(
+				std::function<ModelReplica()> MakeReplica,
+				int Threads,
+				int Population = 100,
+				int Survive = 10,
+				float MutationVariance = 1e-5f,
+				float MutateProbability = 0.1f,
+				float Combine = 0.5f);
+
 			void SetItem(const float* w, int Index = 1, float err = -1.0f);
 			float Iterate();
+			float IterateGeneration();
 			float Update();
 			int BestId();
 			float GetItem(int Index);
 			void SetItem(int Index);
 
 			void OnNewGeneration(std::function<float()> Event);
+			// Every draw comes from a counter-based SplitMix stream keyed by (Seed, Epoch, Index), so generations are reproducible
+			// regardless of threading but differ from the old default_random_engine sequence. The per-gene law is unchanged:
+			// each gene mutates with probability MutateProbability by a uniform step in [-MutationVariance, MutationVariance]
+			void SetSeed(uint64_t s) { Seed = s; Epoch = 0; }
 
 			float
 				MutationVariance,
@@ -86,6 +187,183 @@ namespace PVX {
 			int GenId;
 			float GenPc;
 		}; 
+
+		class SeedGeneticSolver {
+		protected:
+			struct Genome {
+				std::vector<uint64_t> Seeds;
+				float Error;
+				int Parent;
+				bool Mutated;
+			};
+			size_t ModelSize;
+			std::function<float()> ErrorFnc;
+			std::vector<std::pair<float*, size_t>> Updater;
+			std::vector<ModelReplica> Replicas;
+			int Population, Survive;
+			uint64_t Seed;
+			std::vector<float> Base, Elite, NextElite;
+			std::vector<Genome> Generation, Survived;
+			void ApplyMutation(float* Model, uint64_t MutationSeed) const;
+			SeedGeneticSolver(ModelReplica Master, int Population, int Survive, float MutationVariance, float MutateProbability, uint64_t Seed) :
+				SeedGeneticSolver(Master.ErrorFunction, Master.Model, Population, Survive, MutationVariance, MutateProbability, Seed) {}
+		public:
+			SeedGeneticSolver(
+				std::function<float()> ErrorFunction,
+				std::vector<std::pair<float*, size_t>> Model,
+				int Population = 100,
+				int Survive = 10,
+				float MutationVariance = 1e-5f,
+				float MutateProbability = 0.1f,
+				uint64_t Seed = 0);
+			SeedGeneticSolver(
+				std::function<float()> ErrorFunction,
+				float* Model, size_t ModelSize,
+				int Population = 100,
+				int Survive = 10,
+				float MutationVariance = 1e-5f,
+				float MutateProbability = 0.1f,
+				uint64_t Seed = 0);
+			SeedGeneticSolver(
+				std::function<ModelReplica()> MakeReplica,
+				int Threads,
+				int Population = 100,
+				int Survive = 10,
+				float MutationVariance = 1e-5f,
+				float MutateProbability = 0.1f,
+				uint64_t Seed = 0);
+
+			float IterateGeneration();
+			float Update();
+			const std::vector<uint64_t>& BestGenome() const { return Survived[0].Seeds; }
+			void Reconstruct(const std::vector<uint64_t>& Genome, float* Model) const;
+
+			float
+				MutationVariance,
+				Mutate;
+			int GenId = 0;
+		};
+
+		class IslandSolver {
+		protected:
+			struct Mailbox {
+				std::vector<float> Models, Errors;
+				size_t Capacity;
+				std::atomic<size_t> Head{ 0 }, Tail{ 0 };
+				bool Push(const float* Model, float Error, size_t ModelSize);
+				bool Pop(float* Model, float& Error, size_t ModelSize);
+			};
+			struct Island {
+				std::unique_ptr<GeneticSolver> Solver;
+				Mailbox Inbox;
+			};
+			std::vector<std::unique_ptr<Island>> Islands;
+			std::vector<float> Pool;
+			size_t ModelSize;
+			void Migrate(size_t Index);
+		public:
+			IslandSolver(
+				std::function<ModelReplica()> MakeReplica,
+				int Islands = 0,
+				int Population = 100,
+				int Survive = 10,
+				float MutationVariance = 1e-5f,
+				float MutateProbability = 0.1f,
+				float Combine = 0.5f,
+				uint64_t Seed = 0);
+
+			float Run(int Generations);
+			float GetBest(float* Model);
+			int BestIsland();
+			GeneticSolver& operator[](int Index) { return *Islands[Index]->Solver; }
+			int IslandCount() const { return int(Islands.size()); }
+
+			int MigrationInterval = 10;
+			int Migrants = 1;
+		};
+
+		class CMAES {
+		protected:
+			std::function<float()> ErrorFnc;
+			std::vector<std::pair<float*, size_t>> Updater;
+			std::vector<ModelReplica> Replicas;
+			size_t ModelSize;
+			int Lambda, Mu;
+			double Sigma, MuEff, cc, cs, c1, cmu, damps, chiN;
+			Eigen::VectorXd Mean, ps, pc, Weights, D;
+			Eigen::MatrixXd C, B, invSqrtC, Samples;
+			std::vector<float> Errors, Best;
+			float BestError;
+			uint64_t Seed;
+			int64_t EigenGeneration = 0;
+			void Evaluate();
+			void UpdateEigen();
+			CMAES(ModelReplica Master, float Sigma, int Lambda, uint64_t Seed) :
+				CMAES(Master.ErrorFunction, Master.Model, Sigma, Lambda, Seed) {}
+		public:
+			CMAES(
+				std::function<float()> ErrorFunction,
+				std::vector<std::pair<float*, size_t>> Model,
+				float Sigma = 0.1f,
+				int Lambda = 0,
+				uint64_t Seed = 0);
+			CMAES(
+				std::function<float()> ErrorFunction,
+				float* Model, size_t ModelSize,
+				float Sigma = 0.1f,
+				int Lambda = 0,
+				uint64_t Seed = 0);
+			CMAES(
+				std::function<ModelReplica()> MakeReplica,
+				int Threads,
+				float Sigma = 0.1f,
+				int Lambda = 0,
+				uint64_t Seed = 0);
+
+			float Iterate();
+			float Update();
+			float StepSize() const { return float(Sigma); }
+			int PopulationSize() const { return Lambda; }
+
+			int64_t Generation = 0;
+		};
+
+		struct kMeanResult {
+			Eigen::MatrixXf Centroids;
+			std::vector<int> Labels;
+			int Iterations;
+			double Inertia;
+		};
+
+		enum class kMeanInit {
+			Random,
+			PlusPlus
+		};
+
+		struct kMeanOptions {
+			kMeanInit Init = kMeanInit::PlusPlus;
+			bool Accelerated = true;
+			int MaxIterations = 300;
+			int Threads = 0;
+			uint64_t Seed = 0;
+		};
+
 		std::vector<std::vector<float>> kMean(const std::vector<std::vector<float>>& vecs, size_t nClusters);
+		kMeanResult kMean(const Eigen::MatrixXf& Points, size_t nClusters, const kMeanOptions& Options = {});
+
+		class kMeanMiniBatch {
+		protected:
+			size_t nClusters;
+			int Threads;
+			std::mt19937_64 gen;
+			Eigen::MatrixXf Centroids;
+			std::vector<int64_t> Counts;
+			std::vector<int> Labels;
+		public:
+			kMeanMiniBatch(size_t nClusters, uint64_t Seed = 0, int Threads = 0);
+			void Update(const Eigen::MatrixXf& Batch);
+			std::vector<int> Predict(const Eigen::MatrixXf& Points) const;
+			const Eigen::MatrixXf& GetCentroids() const { return Centroids; }
+		};
 	}
 }
\ No newline at end of file
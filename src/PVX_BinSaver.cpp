@@ -1,6 +1,38 @@
 #include <PVX_BinSaver.h>
+#include "PVX_Compat.h"
+#include <string.h>
+#include <algorithm>
+#include <exception>
+#include <istream>
+#include <ostream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#endif
 
 namespace PVX {
+	int Seek64(FILE* f, int64_t Offset, int Origin) {
+#ifdef _WIN32
+		return _fseeki64(f, Offset, Origin);
+#else
+		return fseeko(f, Offset, Origin);
+#endif
+	}
+	int64_t Tell64(FILE* f) {
+#ifdef _WIN32
+		return _ftelli64(f);
+#else
+		return ftello(f);
+#endif
+	}
+
 	BinSaver::BinSaver(const char* Filename, const char* head) {
 		if (fopen_s(&fout, Filename, "wb"))return;
 		Begin(head);
@@ -14,83 +46,246 @@ namespace PVX {
 	BinSaver::BinSaver(const std::string& Filename) :BinSaver(Filename.c_str(), "PVXB") {}
 	BinSaver::BinSaver(const char* Filename) : BinSaver(Filename, "PVXB") {}
 
-	void BinSaver::Begin(const char* Name) {
-		fwrite(Name, 1, 4, fout);
-		SizePos.push_back(ftell(fout));
-		fwrite(Name, 1, 4, fout);
+	BinSaver::BinSaver(std::vector<unsigned char>& Output, const char* head) : Target{ &Output } {
+		Begin(head);
+	}
+	BinSaver::BinSaver(std::ostream& Output, const char* head) : Stream{ &Output } {
+		Begin(head);
+	}
+
+	void BinSaver::Begin(const char* Name, int Wide) {
+		Buffer.insert(Buffer.end(), Name, Name + 4);
+		SizePos.push_back(Buffer.size());
+		if (Wide) {
+			unsigned int Marker = ~0u;
+			Buffer.insert(Buffer.end(), (unsigned char*)&Marker, (unsigned char*)&Marker + 4);
+			Buffer.insert(Buffer.end(), sizeof(uint64_t), 0);
+		} else {
+			Buffer.insert(Buffer.end(), Name, Name + 4);
+		}
+
+		BinIndexEntry e;
+		e.iName = *(unsigned int*)Name;
+		e.Parent = OpenEntries.size() ? (unsigned int)OpenEntries.back() : ~0u;
+		e.Offset = SizePos.back() + 4 + (Wide ? sizeof(uint64_t) : 0);
+		e.Size = 0;
+		OpenEntries.push_back(Entries.size());
+		Entries.push_back(e);
 	}
 
 	size_t BinSaver::write(const void* buffer, size_t size, size_t count) {
-		return fwrite(buffer, size, count, fout);
+		auto p = (const unsigned char*)buffer;
+		Buffer.insert(Buffer.end(), p, p + size * count);
+		return count;
 	}
 
 	size_t BinSaver::write(const std::vector<unsigned char>& Bytes) {
-		return write(&Bytes[0], 1, Bytes.size());
+		return write(Bytes.data(), 1, Bytes.size());
 	}
 
 	int BinSaver::OK() {
-		return fout != NULL;
+		return fout != NULL || Target || Stream;
+	}
+
+	void BinSaver::Wide() {
+		size_t pos = SizePos.back();
+		unsigned int Marker = ~0u;
+		if (!memcmp(&Buffer[pos], &Marker, 4)) return;
+		if (Buffer.size() != pos + 4) throw "Only an empty chunk can be made wide";
+		memcpy(&Buffer[pos], &Marker, 4);
+		Buffer.insert(Buffer.end(), sizeof(uint64_t), 0);
+		Entries[OpenEntries.back()].Offset += sizeof(uint64_t);
 	}
 
 	void BinSaver::End() {
-		long cur = ftell(fout);
-		long pos = SizePos[SizePos.size() - 1];
+		size_t pos = SizePos.back();
+		uint64_t sz = Buffer.size() - pos - 4;
+		unsigned int Marker = ~0u;
+		if (!memcmp(&Buffer[pos], &Marker, 4)) {
+			sz -= sizeof(uint64_t);
+			memcpy(&Buffer[pos + 4], &sz, sizeof(uint64_t));
+		} else {
+			if (sz >= Marker) throw "Chunk exceeds 4 GB; open it wide";
+			unsigned int sz32 = (unsigned int)sz;
+			memcpy(&Buffer[pos], &sz32, 4);
+		}
 		SizePos.pop_back();
-		fseek(fout, pos, SEEK_SET);
-		pos = cur - pos - 4;
-		fwrite(&pos, 4, 1, fout);
-		fseek(fout, cur, SEEK_SET);
+
+		Entries[OpenEntries.back()].Size = sz;
+		OpenEntries.pop_back();
 	}
 
-	int BinSaver::Save() {
+	void BinSaver::Indexed(int Enable) {
+		WriteIndex = Enable;
+	}
+
+	void BinSaver::Sync(int Enable) {
+		SyncOnSave = Enable;
+	}
+
+	void BinSaver::Align(size_t Alignment, int Wide) {
+		size_t pos = Buffer.size() + 2 * sizeof(BinHeader) + (Wide ? sizeof(uint64_t) : 0);
+		size_t pad = (Alignment - pos % Alignment) % Alignment;
+		std::vector<unsigned char> zero(pad);
+		Begin("PADD");
+		if (pad) write(zero);
 		End();
-		fclose(fout);
+	}
+
+	int BinSaver::Save() {
+		if (!OK()) return 0;
+		try {
+			if (WriteIndex && SizePos.size() == 1) {
+				auto Index = Entries;
+				uint64_t IndexPos = Buffer.size() + sizeof(BinHeader);
+				Write("TOCX", Index.data(), Index.size());
+				Write("TOCP", IndexPos);
+			}
+			End();
+		} catch (...) {
+			if (fout) fclose(fout);
+			fout = 0;
+			Target = nullptr;
+			Stream = nullptr;
+			std::vector<unsigned char>().swap(Buffer);
+			throw;
+		}
+		const size_t Block = 1 << 26;
+		size_t Written = 0, Total = Buffer.size();
+		if (Target) {
+			*Target = std::move(Buffer);
+			Written = Total;
+		} else if (Stream) {
+			for (size_t i = 0; i < Total && Stream->good(); i += Block) {
+				Stream->write((const char*)Buffer.data() + i, std::min(Block, Total - i));
+				if (Stream->good()) Written += std::min(Block, Total - i);
+			}
+			Stream->flush();
+		} else {
+			for (size_t i = 0; i < Total; i += Block)
+				Written += fwrite(Buffer.data() + i, 1, std::min(Block, Total - i), fout);
+			if (SyncOnSave) {
+				fflush(fout);
+#ifdef _WIN32
+				_commit(_fileno(fout));
+#else
+				fsync(fileno(fout));
+#endif
+			}
+			fclose(fout);
+		}
 		fout = 0;
-		return SizePos.size() == 0;
+		Target = nullptr;
+		Stream = nullptr;
+		std::vector<unsigned char>().swap(Buffer);
+		return SizePos.size() == 0 && Written == Total;
 	}
 
 	BinSaver::~BinSaver() {
-		if (fout) Save();
+		if (OK()) try { Save(); } catch (...) {}
 	}
 
-	BinLoader::BinLoader(FILE* fin, size_t Size, BinLoader* Parent) {
+	class FileSource : public BinSource {
+		FILE* fin;
+	public:
+		FileSource(FILE* fin) : fin{ fin } {}
+		~FileSource() { fclose(fin); }
+		size_t Read(void* Data, size_t Size) { return fread_s(Data, Size, 1, Size, fin); }
+		int Seek(int64_t Offset, int Origin) { return Seek64(fin, Offset, Origin); }
+		int64_t Tell() { return Tell64(fin); }
+	};
+
+	class MemorySource : public BinSource {
+		const unsigned char* Data;
+		size_t Size, Pos = 0;
+	public:
+		MemorySource(const void* Data, size_t Size) : Data{ (const unsigned char*)Data }, Size{ Size } {}
+		size_t Read(void* Out, size_t sz) {
+			sz = std::min(sz, Size - Pos);
+			memcpy(Out, Data + Pos, sz);
+			Pos += sz;
+			return sz;
+		}
+		int Seek(int64_t Offset, int Origin) {
+			int64_t p = Offset + (Origin == SEEK_CUR ? int64_t(Pos) : Origin == SEEK_END ? int64_t(Size) : 0);
+			if (p < 0 || p > int64_t(Size)) return -1;
+			Pos = size_t(p);
+			return 0;
+		}
+		int64_t Tell() { return int64_t(Pos); }
+	};
+
+	class StreamSource : public BinSource {
+		std::istream& in;
+	public:
+		StreamSource(std::istream& in) : in{ in } {}
+		size_t Read(void* Data, size_t Size) {
+			in.read((char*)Data, Size);
+			return size_t(in.gcount());
+		}
+		int Seek(int64_t Offset, int Origin) {
+			in.clear();
+			if (in.seekg(Offset, Origin == SEEK_CUR ? std::ios::cur : Origin == SEEK_END ? std::ios::end : std::ios::beg)) return 0;
+			in.clear();
+			if (Origin != SEEK_CUR || Offset < 0) return -1;
+			in.ignore(Offset);
+			return in.gcount() == Offset ? 0 : -1;
+		}
+		int64_t Tell() { return int64_t(in.tellg()); }
+	};
+
+	BinLoader::BinLoader(BinSource* fin, size_t Size, BinLoader* Parent) {
 		this->fin = fin;
 		this->Size = Size;
 		this->Parent = Parent;
 		cur = 0;
 	}
-	BinLoader::BinLoader(const char* fn, const char* header) {
-		fopen_s(&fin, fn, "rb");
+	void BinLoader::Open(const char* header) {
+		fin = Source.get();
 		BinHeader hd;
-		if (fin) {
-			cur = fread_s(&hd, sizeof(BinHeader), 1, sizeof(BinHeader), fin);
-			if (cur == sizeof(BinHeader) && hd.iName == (*(int*)header)) {
-				Size = hd.Size;
-			}
-		}
+		cur = Size = 0;
+		if (fin && ReadHeader(hd, Size) && hd.iName != (*(unsigned int*)header))
+			Size = 0;
+		Start = fin ? size_t(fin->Tell()) : 0;
 		Parent = 0;
 	}
+	BinLoader::BinLoader(const char* fn, const char* header) {
+		FILE* f;
+		if (!fopen_s(&f, fn, "rb") && f) Source = std::make_unique<FileSource>(f);
+		Open(header);
+	}
 	BinLoader::BinLoader(const wchar_t* fn, const char* header) {
-		_wfopen_s(&fin, fn, L"rb");
-		BinHeader hd;
-		if (fin) {
-			int sz = sizeof(BinHeader);
-			cur = fread_s(&hd, sizeof(BinHeader), 1, sizeof(BinHeader), fin);
-			if (cur == sizeof(BinHeader) && hd.iName == (*(int*)header)) {
-				Size = hd.Size;
-			}
+		FILE* f;
+		if (!_wfopen_s(&f, fn, L"rb") && f) Source = std::make_unique<FileSource>(f);
+		Open(header);
+	}
+	BinLoader::BinLoader(std::unique_ptr<BinSource> Src, const char* header) : Source{ std::move(Src) } {
+		Open(header);
+	}
+	BinLoader::BinLoader(const void* Data, size_t Size, const char* header) : Source{ std::make_unique<MemorySource>(Data, Size) } {
+		Open(header);
+	}
+	BinLoader::BinLoader(std::istream& Stream, const char* header) : Source{ std::make_unique<StreamSource>(Stream) } {
+		Open(header);
+	}
+	int BinLoader::ReadHeader(BinHeader& hd, size_t& sz) {
+		if (fin->Read(&hd, sizeof(BinHeader)) != sizeof(BinHeader)) return 0;
+		sz = hd.Size;
+		if (hd.Size == ~0u) {
+			uint64_t sz64;
+			if (fin->Read(&sz64, sizeof(uint64_t)) != sizeof(uint64_t)) return 0;
+			sz = size_t(sz64);
+			return sizeof(BinHeader) + sizeof(uint64_t);
 		}
-		Parent = 0;
+		return sizeof(BinHeader);
 	}
 	BinLoader::BinLoader(const std::string& fn) :BinLoader(fn.c_str(), "PVXB") {}
 	BinLoader::BinLoader(const char* fn) : BinLoader(fn, "PVXB") {}
 	BinLoader::~BinLoader() {
-		if (cur < Size)
+		if (cur < Size && !std::uncaught_exceptions())
 			Execute();
-		if (Parent) {
+		if (Parent)
 			Parent->cur += Size;
-		} else
-			fin&& fclose(fin);
 	}
 	void BinLoader::Process(const char* header, std::function<void(BinLoader&)> Loader) {
 		this->Loader[*(unsigned int*)header] = Loader;
@@ -99,10 +294,10 @@ namespace PVX {
 		this->AnyLoader = Loader;
 	}
 	void BinLoader::Read(void* Data, size_t sz) {
-		cur += fread_s(Data, sz, 1, sz, fin);
+		cur += fin->Read(Data, sz);
 	}
 	size_t BinLoader::ReadAll(void* Data) {
-		auto sz = fread_s(Data, Size - cur, 1, Size - cur, fin);
+		auto sz = fin->Read(Data, Size - cur);
 		cur = Size;
 		return sz;
 	}
@@ -113,17 +308,25 @@ namespace PVX {
 	}
 	void BinLoader::Execute() {
 		BinHeader hd;
+		size_t sz;
 		while (cur < Size) {
-			cur += fread_s(&hd, sizeof(BinHeader), 1, sizeof(BinHeader), fin);
+			int h = ReadHeader(hd, sz);
+			if (!h) {
+				cur = Size;
+				break;
+			}
+			cur += h;
 			if (Loader.find(hd.iName) != Loader.end()) {
-				BinLoader bl(fin, hd.Size, this);
+				BinLoader bl(fin, sz, this);
 				Loader[hd.iName](bl);
+				if (bl.cur < bl.Size) bl.Execute();
 			} else if (AnyLoader != nullptr) {
-				BinLoader bl(fin, hd.Size, this);
+				BinLoader bl(fin, sz, this);
 				AnyLoader(bl, hd.sName);
+				if (bl.cur < bl.Size) bl.Execute();
 			} else {
-				fseek(fin, hd.Size, SEEK_CUR);
-				cur += hd.Size;
+				fin->Seek(sz, SEEK_CUR);
+				cur += sz;
 			}
 		}
 	}
@@ -148,9 +351,99 @@ namespace PVX {
 		return ret;
 	}
 
+	size_t BinLoader::Position() {
+		return size_t(fin->Tell());
+	}
+	void BinLoader::Skip() {
+		fin->Seek(int64_t(Size - cur), SEEK_CUR);
+		cur = Size;
+	}
+
+	std::vector<BinIndexEntry> BinLoader::ReadIndex() {
+		std::vector<BinIndexEntry> ret;
+		if (!fin || Parent || Size < 2 * sizeof(BinHeader)) return ret;
+		int64_t save = fin->Tell();
+		BinHeader hd;
+		uint64_t IndexPos;
+		if (!fin->Seek(int64_t(Start + Size - sizeof(BinHeader) - sizeof(uint64_t)), SEEK_SET) &&
+			fin->Read(&hd, sizeof(BinHeader)) == sizeof(BinHeader) && hd.iName == TAG('T', 'O', 'C', 'P') && hd.Size == sizeof(uint64_t) &&
+			fin->Read(&IndexPos, sizeof(uint64_t)) == sizeof(uint64_t) &&
+			!fin->Seek(int64_t(IndexPos - sizeof(BinHeader)), SEEK_SET) &&
+			fin->Read(&hd, sizeof(BinHeader)) == sizeof(BinHeader) && hd.iName == TAG('T', 'O', 'C', 'X')) {
+			ret.resize(hd.Size / sizeof(BinIndexEntry));
+			if (ret.size() && fin->Read(ret.data(), ret.size() * sizeof(BinIndexEntry)) != ret.size() * sizeof(BinIndexEntry))
+				ret.clear();
+		}
+		fin->Seek(save, SEEK_SET);
+		return ret;
+	}
+
+	void BinLoader::Seek(const BinIndexEntry& Entry, std::function<void(BinLoader&)> Loader) {
+		int64_t save = fin->Tell();
+		size_t saveCur = cur;
+		fin->Seek(int64_t(Entry.Offset), SEEK_SET);
+		{
+			BinLoader bl(fin, Entry.Size, this);
+			Loader(bl);
+		}
+		cur = saveCur;
+		fin->Seek(save, SEEK_SET);
+	}
+
 	void BinLoader::ReadBytes(std::vector<unsigned char>& Bytes, size_t size) {
 		if (!size) size = Remaining();
 		Bytes.resize(size);
 		Read(&Bytes[0], size);
 	}
+
+#ifdef _WIN32
+	int RenameFile(const wchar_t* From, const wchar_t* To) {
+		return MoveFileExW(From, To, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+	}
+	BinMapping::BinMapping(const wchar_t* Filename) {
+		HANDLE file = CreateFileW(Filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) return;
+		LARGE_INTEGER sz;
+		GetFileSizeEx(file, &sz);
+		HANDLE map = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		CloseHandle(file);
+		if (!map) return;
+		Data = (char*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+		if (!Data) {
+			CloseHandle(map);
+			return;
+		}
+		Handle = map;
+		Size = size_t(sz.QuadPart);
+	}
+	BinMapping::~BinMapping() {
+		if (Data) UnmapViewOfFile(Data);
+		if (Handle) CloseHandle(Handle);
+	}
+#else
+	int RenameFile(const wchar_t* From, const wchar_t* To) {
+		std::string from(wcstombs(nullptr, From, 0), 0), to(wcstombs(nullptr, To, 0), 0);
+		wcstombs(&from[0], From, from.size());
+		wcstombs(&to[0], To, to.size());
+		return rename(from.c_str(), to.c_str()) == 0;
+	}
+	BinMapping::BinMapping(const wchar_t* Filename) {
+		std::string fn(wcstombs(nullptr, Filename, 0), 0);
+		wcstombs(&fn[0], Filename, fn.size());
+		int fd = open(fn.c_str(), O_RDONLY);
+		if (fd < 0) return;
+		struct stat st;
+		if (!fstat(fd, &st) && st.st_size > 0) {
+			void* m = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+			if (m != MAP_FAILED) {
+				Data = (char*)m;
+				Size = size_t(st.st_size);
+			}
+		}
+		close(fd);
+	}
+	BinMapping::~BinMapping() {
+		if (Data) munmap(Data, Size);
+	}
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include <PVX_Solvers.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <cmath>
+
+namespace PVX::Solvers {
+	inline size_t GetModelSize(const std::vector<std::pair<float*, size_t>>& m) {
+		size_t ret = 0;
+		for (auto [d, s]:m)ret += s;
+		return ret;
+	}
+	inline void Memcpy(float* dst, const std::vector<std::pair<float*, size_t>>& m) {
+		for (auto [f, s]: m) {
+			memcpy(dst, f, s * sizeof(float));
+			dst += s;
+		}
+	}
+	inline void Memcpy(std::vector<std::pair<float*, size_t>>& dst, const float* m) {
+		float* src = (float*)m;
+		for (auto [f, s]: dst) {
+			memcpy(f, src, s * sizeof(float));
+			src += s;
+		}
+	}
+
+	CMAES::CMAES(
+		std::function<float()> ErrorFunction,
+		std::vector<std::pair<float*, size_t>> Model,
+		float Sigma,
+		int Lambda,
+		uint64_t Seed) :
+		ErrorFnc{ ErrorFunction },
+		Updater{ Model },
+		ModelSize{ GetModelSize(Model) },
+		Sigma{ Sigma },
+		Seed{ Seed }
+	{
+		const double N = double(ModelSize);
+		this->Lambda = Lambda > 0 ? Lambda : 4 + int(3.0 * std::log(N));
+		Mu = this->Lambda / 2;
+		Weights.resize(Mu);
+		for (auto i = 0; i < Mu; i++) Weights[i] = std::log(Mu + 0.5) - std::log(i + 1.0);
+		Weights /= Weights.sum();
+		MuEff = 1.0 / Weights.squaredNorm();
+
+		cc = (4.0 + MuEff / N) / (N + 4.0 + 2.0 * MuEff / N);
+		cs = (MuEff + 2.0) / (N + MuEff + 5.0);
+		c1 = 2.0 / ((N + 1.3) * (N + 1.3) + MuEff);
+		cmu = std::min(1.0 - c1, 2.0 * (MuEff - 2.0 + 1.0 / MuEff) / ((N + 2.0) * (N + 2.0) + MuEff));
+		damps = 1.0 + 2.0 * std::max(0.0, std::sqrt((MuEff - 1.0) / (N + 1.0)) - 1.0) + cs;
+		chiN = std::sqrt(N) * (1.0 - 1.0 / (4.0 * N) + 1.0 / (21.0 * N * N));
+
+		Best.resize(ModelSize);
+		Memcpy(Best.data(), Updater);
+		Mean = Eigen::Map<Eigen::VectorXf>(Best.data(), ModelSize).cast<double>();
+		ps = pc = Eigen::VectorXd::Zero(ModelSize);
+		D = Eigen::VectorXd::Ones(ModelSize);
+		C = B = invSqrtC = Eigen::MatrixXd::Identity(ModelSize, ModelSize);
+		Samples.resize(ModelSize, this->Lambda);
+		Errors.resize(this->Lambda);
+		BestError = ErrorFnc();
+	}
+
+	CMAES::CMAES(
+		std::function<float()> ErrorFunction,
+		float* Model, size_t ModelSize,
+		float Sigma,
+		int Lambda,
+		uint64_t Seed) : CMAES(ErrorFunction, { {Model, ModelSize} }, Sigma, Lambda, Seed) {}
+
+	CMAES::CMAES(
+		std::function<ModelReplica()> MakeReplica,
+		int Threads,
+		float Sigma,
+		int Lambda,
+		uint64_t Seed) : CMAES(MakeReplica(), Sigma, Lambda, Seed)
+	{
+		if (Threads <= 0) Threads = std::max(1u, std::thread::hardware_concurrency());
+		Threads = std::min(Threads, this->Lambda);
+		for (auto i = 1; i < Threads; i++) {
+			Replicas.push_back(MakeReplica());
+			if (GetModelSize(Replicas.back().Model) != ModelSize) throw "Replica model size mismatch";
+		}
+	}
+
+	void CMAES::Evaluate() {
+		std::atomic<int> Next = 0;
+		std::exception_ptr Failed;
+		std::mutex FailLock;
+		auto Worker = [&](std::function<float()>& ErrorFunction, std::vector<std::pair<float*, size_t>>& Model) {
+			try {
+				std::vector<float> x(ModelSize);
+				Eigen::VectorXd z(ModelSize);
+				for (int i; (i = Next++) < Lambda;) {
+					std::mt19937_64 rng(Seed ^ (uint64_t(Generation) * Lambda + i) * 0x9E3779B97F4A7C15ull);
+					std::normal_distribution<double> Normal;
+					for (size_t j = 0; j < ModelSize; j++) z[j] = Normal(rng);
+					Samples.col(i) = Mean + Sigma * (B * D.cwiseProduct(z));
+					Eigen::Map<Eigen::VectorXf>(x.data(), ModelSize) = Samples.col(i).cast<float>();
+					Memcpy(Model, x.data());
+					Errors[i] = ErrorFunction();
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock{ FailLock };
+				if (!Failed) Failed = std::current_exception();
+				Next = Lambda;
+			}
+		};
+		std::vector<std::thread> Workers;
+		for (auto& r : Replicas)
+			Workers.emplace_back([&Worker, &r] { Worker(r.ErrorFunction, r.Model); });
+		Worker(ErrorFnc, Updater);
+		for (auto& w : Workers) w.join();
+		if (Failed) std::rethrow_exception(Failed);
+	}
+
+	void CMAES::UpdateEigen() {
+		C = C.triangularView<Eigen::Upper>();
+		C = C.selfadjointView<Eigen::Upper>();
+		Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> Solver(C);
+		B = Solver.eigenvectors();
+		D = Solver.eigenvalues().cwiseMax(1e-20).cwiseSqrt();
+		invSqrtC = B * D.cwiseInverse().asDiagonal() * B.transpose();
+	}
+
+	float CMAES::Iterate() {
+		Evaluate();
+		Generation++;
+
+		std::vector<int> Order(Lambda);
+		std::iota(Order.begin(), Order.end(), 0);
+		std::sort(Order.begin(), Order.end(), [&](int a, int b) { return Errors[a] < Errors[b]; });
+		if (Errors[Order[0]] < BestError) {
+			BestError = Errors[Order[0]];
+			Eigen::Map<Eigen::VectorXf>(Best.data(), ModelSize) = Samples.col(Order[0]).cast<float>();
+		}
+
+		const double N = double(ModelSize);
+		Eigen::VectorXd Old = Mean;
+		Eigen::MatrixXd Y(ModelSize, Mu);
+		for (auto i = 0; i < Mu; i++) Y.col(i) = (Samples.col(Order[i]) - Old) / Sigma;
+		Eigen::VectorXd Step = Y * Weights;
+		Mean = Old + Sigma * Step;
+
+		ps = (1.0 - cs) * ps + std::sqrt(cs * (2.0 - cs) * MuEff) * (invSqrtC * Step);
+		double hsig = ps.norm() / std::sqrt(1.0 - std::pow(1.0 - cs, 2.0 * Generation)) / chiN < 1.4 + 2.0 / (N + 1.0) ? 1.0 : 0.0;
+		pc = (1.0 - cc) * pc + hsig * std::sqrt(cc * (2.0 - cc) * MuEff) * Step;
+
+		C = (1.0 - c1 - cmu) * C
+			+ c1 * (pc * pc.transpose() + (1.0 - hsig) * cc * (2.0 - cc) * C)
+			+ cmu * Y * Weights.asDiagonal() * Y.transpose();
+		Sigma *= std::exp((cs / damps) * (ps.norm() / chiN - 1.0));
+
+		if (double(Generation - EigenGeneration) * Lambda > Lambda / (c1 + cmu) / N / 10.0) {
+			EigenGeneration = Generation;
+			UpdateEigen();
+		}
+		return BestError;
+	}
+
+	float CMAES::Update() {
+		Memcpy(Updater, Best.data());
+		return BestError;
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef __PVX_COMPAT_H__
+#define __PVX_COMPAT_H__
+
+#ifndef _WIN32
+#include<stdio.h>
+#include<string.h>
+#include<stdlib.h>
+#include<errno.h>
+#include<string>
+inline int fopen_s(FILE** File, const char* Filename, const char* Mode) {
+	*File = fopen(Filename, Mode);
+	return *File == nullptr;
+}
+inline int _wfopen_s(FILE** File, const wchar_t* Filename, const wchar_t* Mode) {
+	*File = nullptr;
+	size_t fnSize = wcstombs(nullptr, Filename, 0), modeSize = wcstombs(nullptr, Mode, 0);
+	if (fnSize == size_t(-1) || modeSize == size_t(-1)) return 1;
+	std::string fn(fnSize, 0), mode(modeSize, 0);
+	wcstombs(&fn[0], Filename, fn.size());
+	wcstombs(&mode[0], Mode, mode.size());
+	return fopen_s(File, fn.c_str(), mode.c_str());
+}
+inline size_t fread_s(void* Buffer, size_t BufferSize, size_t ElementSize, size_t Count, FILE* File) {
+	if (ElementSize && Count > BufferSize / ElementSize) return 0;
+	return fread(Buffer, ElementSize, Count, File);
+}
+inline int memcpy_s(void* Dest, size_t DestSize, const void* Src, size_t Count) {
+	if (Count > DestSize) {
+		if (Dest) memset(Dest, 0, DestSize);
+		return ERANGE;
+	}
+	memcpy(Dest, Src, Count);
+	return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+#include <PVX_Solvers.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace PVX::Solvers {
+
+	inline size_t GetModelSize(const std::vector<std::pair<float*, size_t>>& m) {
+		size_t ret = 0;
+		for (auto [d, s]:m)ret += s;
+		return ret;
+	}
+	inline void Memcpy(float* dst, const std::vector<std::pair<float*, size_t>>& m) {
+		for (auto [f, s]: m) {
+			memcpy(dst, f, s * sizeof(float));
+			dst += s;
+		}
+	}
+	inline void Memcpy(std::vector<std::pair<float*, size_t>>& dst, const float* m) {
+		float* src = (float*)m;
+		for (auto [f, s]: dst) {
+			memcpy(f, src, s * sizeof(float));
+			src += s;
+		}
+	}
+
+	static void Perturb(std::vector<std::pair<float*, size_t>>& Model, const float* Base, const float* Noise, float d) {
+		for (auto [w, sz] : Model) {
+			for (size_t i = 0; i < sz; i++)
+				w[i] = Base[i] + d * Noise[i];
+			Base += sz;
+			Noise += sz;
+		}
+	}
+
+	std::shared_ptr<const std::vector<float>> EvolutionStrategies::NoiseTable(size_t Size, uint64_t Seed) {
+		static std::mutex Lock;
+		static std::map<std::pair<size_t, uint64_t>, std::weak_ptr<const std::vector<float>>> Tables;
+		std::lock_guard<std::mutex> lock{ Lock };
+		auto& Cached = Tables[{ Size, Seed }];
+		if (auto ret = Cached.lock()) return ret;
+
+		auto Table = std::make_shared<std::vector<float>>(Size);
+		std::mt19937_64 rng(Seed);
+		std::normal_distribution<float> Normal;
+		for (auto& n : *Table) n = Normal(rng);
+		Cached = Table;
+		return Table;
+	}
+
+	void EvolutionStrategies::Gradient(float Sigma) {
+		const float* Table = Noise->data();
+		const size_t Range = Noise->size() - ModelSize + 1;
+		for (int k = 0; k < Pairs; k++) {
+			std::mt19937_64 rng(Seed + Step * Pairs + k);
+			Offsets[k] = rng() % Range;
+		}
+		Step++;
+
+		Memcpy(Current.data(), Updater);
+		std::atomic<int> Next = 0;
+		RunWorkers([&](size_t Index, std::function<float()>& ErrorFunction, std::vector<std::pair<float*, size_t>>& Model) {
+			for (int k; (k = Next++) < 2 * Pairs;) {
+				Perturb(Model, Current.data(), Table + Offsets[k >> 1], k & 1 ? -Sigma : Sigma);
+				Errors[k] = ErrorFunction();
+			}
+			if (!Index) Memcpy(Model, Current.data());
+		});
+
+		for (int k = 0; k < 2 * Pairs; k++)
+			Ranks[k] = { Errors[k], k };
+		std::sort(Ranks.begin(), Ranks.end());
+		std::vector<float> Utility(2 * Pairs), Weight(Pairs);
+		const float Scale = 1.0f / float(2 * Pairs - 1);
+		for (int r = 0; r < 2 * Pairs; r++)
+			Utility[Ranks[r].second] = 0.5f - r * Scale;
+		for (int k = 0; k < Pairs; k++)
+			Weight[k] = (Utility[2 * k] - Utility[2 * k + 1]) / (Pairs * Sigma);
+
+		std::atomic<size_t> NextBlock = 0;
+		const size_t Block = 4096;
+		RunWorkers([&](size_t, std::function<float()>&, std::vector<std::pair<float*, size_t>>&) {
+			for (size_t Start; (Start = NextBlock.fetch_add(Block)) < ModelSize;) {
+				size_t End = std::min(Start + Block, ModelSize);
+				float* g = vGradient.data();
+				std::fill(g + Start, g + End, 0.0f);
+				for (int k = 0; k < Pairs; k++) {
+					const float* n = Table + Offsets[k];
+					const float w = Weight[k];
+					for (size_t i = Start; i < End; i++)
+						g[i] += w * n[i];
+				}
+			}
+		});
+	}
+
+	EvolutionStrategies::EvolutionStrategies(
+		std::function<float()> ErrorFunction,
+		std::vector<std::pair<float*, size_t>> Model,
+		int Pairs,
+		float LearnRate, float Momentum, float RMSprop,
+		size_t NoiseSize, uint64_t Seed
+	) : GradientDescent(ErrorFunction, Model, LearnRate, Momentum, RMSprop),
+		Pairs{ std::max(1, Pairs) },
+		Seed{ Seed },
+		Noise{ NoiseTable(std::max(NoiseSize, std::max(ModelSize * 16, size_t(1) << 20)), Seed) },
+		Offsets(this->Pairs),
+		Errors(2 * this->Pairs),
+		Ranks(2 * this->Pairs)
+	{ Current.resize(ModelSize); }
+
+	EvolutionStrategies::EvolutionStrategies(
+		std::function<float()> ErrorFunction,
+		float* Model, size_t ModelSize,
+		int Pairs,
+		float LearnRate, float Momentum, float RMSprop,
+		size_t NoiseSize, uint64_t Seed
+	) : EvolutionStrategies(ErrorFunction, { {Model, ModelSize} }, Pairs, LearnRate, Momentum, RMSprop, NoiseSize, Seed) {}
+
+	EvolutionStrategies::EvolutionStrategies(
+		std::function<Replica()> MakeReplica, int Pairs, int Threads,
+		float LearnRate, float Momentum, float RMSprop,
+		size_t NoiseSize, uint64_t Seed
+	) : GradientDescent(MakeReplica, std::min(Threads > 0 ? Threads : int(std::max(1u, std::thread::hardware_concurrency())), 2 * std::max(1, Pairs)), LearnRate, Momentum, RMSprop),
+		Pairs{ std::max(1, Pairs) },
+		Seed{ Seed },
+		Noise{ NoiseTable(std::max(NoiseSize, std::max(ModelSize * 16, size_t(1) << 20)), Seed) },
+		Offsets(this->Pairs),
+		Errors(2 * this->Pairs),
+		Ranks(2 * this->Pairs)
+	{}
+}
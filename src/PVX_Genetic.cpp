@@ -1,6 +1,11 @@
 #include <PVX_Solvers.h>
 #include <iostream>
 #include <limits>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
 
 namespace PVX::Solvers {
 	
@@ -23,6 +28,18 @@ namespace PVX::Solvers {
 		}
 	}
 
+	static inline uint64_t Mix(uint64_t x) {
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	struct CounterRng {
+		uint64_t Key, Counter = 0;
+		uint64_t operator()() { return Mix(Key ^ Mix(Counter++)); }
+		double Uniform() { return ((*this)() >> 11) * (1.0 / 9007199254740992.0); }
+	};
 
 
 	GeneticSolver::GeneticSolver(std::function<float()> ErrorFunction, float* Model, size_t ModelSize, int Population, int Survive, float MutationVariance, float MutateProbability, float Combine) :
@@ -47,9 +64,6 @@ namespace PVX::Solvers {
 		MutationVariance{ MutationVariance },
 		Mutate{ Mutate },
 		Combine{ Combine },
-		dist(-1.0f, 1.0f),
-		dist01(0.0f, 1.0f),
-		intDist(0, Survive - 1),
 		curIter{ Population },
 		GenId{ -1 },
 		GenPc{ 0 }
@@ -63,14 +77,33 @@ namespace PVX::Solvers {
 		Survived[0].Model = &Memory[Population * ModelSize];
 		Memcpy(Survived[0].Model, Updater);
 		Survived[0].Error = ErrorFnc();
+		CounterRng rng{ Mix(Seed) };
 		for(auto i = 1;i<Survived.size();i++){
 			Survived[i].Model = Survived[i - size_t(1)].Model + ModelSize;
 			for (int j = 0; j < ModelSize; j++)
-				Survived[i].Model[j] = float(Survived[0].Model[j] + MutationVariance * dist(gen));
+				Survived[i].Model[j] = float(Survived[0].Model[j] + MutationVariance * (rng.Uniform() * 2.0 - 1.0));
 		}
 	}
 
 
+	GeneticSolver::GeneticSolver(
+		std::function<ModelReplica()> MakeReplica,
+		int Threads,
+		int Population,
+		int Survive,
+		float MutationVariance,
+		float Mutate,
+		float Combine) :
+		GeneticSolver(MakeReplica(), Population, Survive, MutationVariance, Mutate, Combine)
+	{
+		if (Threads <= 0) Threads = std::max(1u, std::thread::hardware_concurrency());
+		Threads = std::min(Threads, std::max(1, Population - 1));
+		for (auto i = 1; i < Threads; i++) {
+			Replicas.push_back(MakeReplica());
+			if (GetModelSize(Replicas.back().Model) != ModelSize) throw "Replica model size mismatch";
+		}
+	}
+
 	float GeneticSolver::Iterate() {
 		if (curIter == Population) {
 			NextGeneration();
@@ -80,17 +113,7 @@ namespace PVX::Solvers {
 			GenPc = 0;
 			return Generation[0].Error;
 		} else if (curIter==1 && NewGenEvent.size()) {
-			for (auto f : NewGenEvent) {
-				GetItem(0);
-				auto& g = Generation[curIter];
-				g.Error = f();
-				g.Index = curIter;
-				if (g.Error<0) g.Error = ErrorFnc();
-				Memcpy(g.Model, Updater);
-				if (Generation[0].Error > g.Error)
-					std::swap(g, Generation[0]);
-				curIter++;
-			}
+			NewGenerationEvents();
 			return Generation[0].Error;
 		} else {
 			GenPc = float(curIter) / Population;
@@ -101,16 +124,73 @@ namespace PVX::Solvers {
 			if (Generation[0].Error > g.Error)
 				std::swap(g, Generation[0]);
 			curIter++;
-			if (curIter == Population) {
-				//std::nth_element(Generation.begin()+1, Generation.begin() + Survive, Generation.end(), [](auto a, auto b) { return a.Error<b.Error; });
-				std::partial_sort(Generation.begin()+1, Generation.begin() + Survive, Generation.end(), [](auto a, auto b) { return a.Error<b.Error; });
-				memcpy(Survived[0].Model, Generation[0].Model, sizeof(float) * ModelSize);
-				Survived[0].Error = Generation[0].Error;
-				for (auto i = 1; i<Survive; i++) std::swap(Generation[i], Survived[i]);
-			}
+			if (curIter == Population)
+				SelectSurvivors();
 			return Generation[0].Error;
 		}
 	}
+	void GeneticSolver::NewGenerationEvents() {
+		for (auto f : NewGenEvent) {
+			GetItem(0);
+			auto& g = Generation[curIter];
+			g.Error = f();
+			g.Index = curIter;
+			if (g.Error<0) g.Error = ErrorFnc();
+			Memcpy(g.Model, Updater);
+			if (Generation[0].Error > g.Error)
+				std::swap(g, Generation[0]);
+			curIter++;
+		}
+	}
+	void GeneticSolver::SelectSurvivors() {
+		//std::nth_element(Generation.begin()+1, Generation.begin() + Survive, Generation.end(), [](auto a, auto b) { return a.Error<b.Error; });
+		std::partial_sort(Generation.begin()+1, Generation.begin() + Survive, Generation.end(), [](auto a, auto b) { return a.Error<b.Error; });
+		memcpy(Survived[0].Model, Generation[0].Model, sizeof(float) * ModelSize);
+		Survived[0].Error = Generation[0].Error;
+		for (auto i = 1; i<Survive; i++) std::swap(Generation[i], Survived[i]);
+	}
+	float GeneticSolver::IterateGeneration() {
+		if (curIter == Population) {
+			NextGeneration();
+			curIter = 1;
+			Generation[0].Index = 0;
+			GenId++;
+		}
+		if (curIter == 1 && NewGenEvent.size())
+			NewGenerationEvents();
+
+		std::atomic<int> Next = curIter;
+		std::exception_ptr Failed;
+		std::mutex FailLock;
+		auto Worker = [&](std::function<float()>& ErrorFunction, std::vector<std::pair<float*, size_t>>& Model) {
+			try {
+				for (int i; (i = Next++) < Population;) {
+					auto& g = Generation[i];
+					g.Index = i;
+					Memcpy(Model, g.Model);
+					g.Error = ErrorFunction();
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock{ FailLock };
+				if (!Failed) Failed = std::current_exception();
+				Next = Population;
+			}
+		};
+		std::vector<std::thread> Workers;
+		for (auto& r : Replicas)
+			Workers.emplace_back([&Worker, &r] { Worker(r.ErrorFunction, r.Model); });
+		Worker(ErrorFnc, Updater);
+		for (auto& w : Workers) w.join();
+		if (Failed) std::rethrow_exception(Failed);
+
+		auto Best = std::min_element(Generation.begin() + curIter, Generation.end(), [](auto& a, auto& b) { return a.Error<b.Error; });
+		if (Best != Generation.end() && Generation[0].Error > Best->Error)
+			std::swap(*Best, Generation[0]);
+		curIter = Population;
+		GenPc = 1.0f;
+		SelectSurvivors();
+		return Generation[0].Error;
+	}
 	float GeneticSolver::Update() {
 		return GetItem(0);
 	}
@@ -135,32 +215,181 @@ namespace PVX::Solvers {
 		if (err >= 0) Generation[Index].Error = err;
 		else Generation[Index].Error = ErrorFnc();
 	}
+	static void MutateGenes(float* Model, size_t ModelSize, CounterRng& rng, float Mutate, float MutationVariance) {
+		if (Mutate >= 1.0f) {
+			for (size_t j = 0; j < ModelSize; j++)
+				Model[j] += float((rng.Uniform() * 2.0 - 1.0) * MutationVariance);
+		} else if (Mutate > 0) {
+			double lq = std::log1p(-double(Mutate));
+			for (size_t j = 0; j < ModelSize; j++) {
+				double skip = std::floor(std::log(1.0 - rng.Uniform()) / lq);
+				if (skip >= double(ModelSize - j)) break;
+				j += size_t(skip);
+				Model[j] += float((rng.Uniform() * 2.0 - 1.0) * MutationVariance);
+			}
+		}
+	}
+
+	void GeneticSolver::MakeChild(int Index) {
+		auto& g = Generation[Index];
+		CounterRng rng{ Mix(Seed ^ Mix(Epoch * uint64_t(Population) + Index)) };
+
+		int i1 = int(rng() % Survive);
+		auto& g1 = Survived[i1];
+		if (Survive > 1 && rng.Uniform() < Combine) {
+			int i2 = int((i1 + 1 + rng() % (Survive - 1)) % Survive);
+			const float* a = g1.Model;
+			const float* b = Survived[i2].Model;
+			float* dst = g.Model;
+			for (size_t j = 0; j < ModelSize; j += 64) {
+				uint64_t bits = rng();
+				size_t n = std::min(size_t(64), ModelSize - j);
+				for (size_t k = 0; k < n; k++)
+					dst[j + k] = (bits >> k) & 1 ? a[j + k] : b[j + k];
+			}
+		} else {
+			memcpy(g.Model, g1.Model, sizeof(float) * ModelSize);
+		}
+
+		MutateGenes(g.Model, ModelSize, rng, Mutate, MutationVariance);
+	}
+
 	void GeneticSolver::NextGeneration() {
 		memcpy(Generation[0].Model, Survived[0].Model, sizeof(float) * ModelSize);
 		Generation[0].Error = Survived[0].Error;
 		Generation[0].Index = 0;
-		for (auto i = 1; i<Population; i++) {
-			auto& g = Generation[i];
+		if (Replicas.size() && size_t(Population) * ModelSize >= (1 << 16)) {
+			std::atomic<int> Next = 1;
+			std::vector<std::thread> Workers;
+			auto Work = [&] { for (int i; (i = Next++) < Population;) MakeChild(i); };
+			for (size_t t = 0; t < Replicas.size(); t++) Workers.emplace_back(Work);
+			Work();
+			for (auto& w : Workers) w.join();
+		} else {
+			for (auto i = 1; i<Population; i++)
+				MakeChild(i);
+		}
+		Epoch++;
+	}
 
-			int i1 = intDist(gen);
-			auto& g1 = Survived[i1];
+	SeedGeneticSolver::SeedGeneticSolver(
+		std::function<float()> ErrorFunction,
+		std::vector<std::pair<float*, size_t>> Model,
+		int Population,
+		int Survive,
+		float MutationVariance,
+		float Mutate,
+		uint64_t Seed) :
+		ModelSize{ GetModelSize(Model) },
+		ErrorFnc{ ErrorFunction },
+		Updater{ Model },
+		Population{ Population },
+		Survive{ Survive },
+		Seed{ Seed },
+		MutationVariance{ MutationVariance },
+		Mutate{ Mutate }
+	{
+		Base.resize(ModelSize);
+		Memcpy(Base.data(), Updater);
+		Elite = Base;
+		Survived.push_back({ {}, ErrorFnc(), 0, false });
+	}
 
-			if (dist01(gen) < Combine) {
-				int i2 = intDist(gen);
-				while (i1 == i2) i2 = intDist(gen);
-				auto& g2 = Survived[i2];
-				for (auto j = 0; j<ModelSize; j++) {
-					g.Model[j] = (intDist(gen) & 1) ? g1.Model[j] : g2.Model[j];
-				}
-			} else {
-				memcpy(g.Model, g1.Model, sizeof(float) * ModelSize);
-			}
+	SeedGeneticSolver::SeedGeneticSolver(
+		std::function<float()> ErrorFunction,
+		float* Model, size_t ModelSize,
+		int Population,
+		int Survive,
+		float MutationVariance,
+		float Mutate,
+		uint64_t Seed) :
+		SeedGeneticSolver(ErrorFunction, { {Model, ModelSize} }, Population, Survive, MutationVariance, Mutate, Seed) {}
+
+	SeedGeneticSolver::SeedGeneticSolver(
+		std::function<ModelReplica()> MakeReplica,
+		int Threads,
+		int Population,
+		int Survive,
+		float MutationVariance,
+		float Mutate,
+		uint64_t Seed) :
+		SeedGeneticSolver(MakeReplica(), Population, Survive, MutationVariance, Mutate, Seed)
+	{
+		if (Threads <= 0) Threads = std::max(1u, std::thread::hardware_concurrency());
+		Threads = std::min(Threads, std::max(1, Population - 1));
+		for (auto i = 1; i < Threads; i++) {
+			Replicas.push_back(MakeReplica());
+			if (GetModelSize(Replicas.back().Model) != ModelSize) throw "Replica model size mismatch";
+		}
+	}
 
-			for (auto j = 0; j<ModelSize; j++) {
-				if (dist01(gen) < Mutate) {
-					g.Model[j] += float(dist(gen) * MutationVariance);
+	void SeedGeneticSolver::ApplyMutation(float* Model, uint64_t MutationSeed) const {
+		CounterRng rng{ MutationSeed };
+		MutateGenes(Model, ModelSize, rng, Mutate, MutationVariance);
+	}
+
+	void SeedGeneticSolver::Reconstruct(const std::vector<uint64_t>& Genome, float* Model) const {
+		memcpy(Model, Base.data(), ModelSize * sizeof(float));
+		for (auto s : Genome)
+			ApplyMutation(Model, s);
+	}
+
+	float SeedGeneticSolver::IterateGeneration() {
+		Generation.resize(Population);
+		Generation[0] = Survived[0];
+		Generation[0].Parent = 0;
+		Generation[0].Mutated = false;
+		for (auto i = 1; i < Population; i++) {
+			auto& g = Generation[i];
+			CounterRng rng{ Mix(Seed ^ Mix(uint64_t(GenId) * Population + i)) };
+			g.Parent = int(rng() % Survived.size());
+			g.Seeds = Survived[g.Parent].Seeds;
+			g.Seeds.push_back(rng());
+			g.Mutated = true;
+		}
+
+		std::atomic<int> Next = 1;
+		std::exception_ptr Failed;
+		std::mutex FailLock;
+		auto Worker = [&](std::function<float()>& ErrorFunction, std::vector<std::pair<float*, size_t>>& Model) {
+			try {
+				std::vector<float> Scratch(ModelSize);
+				for (int i; (i = Next++) < Population;) {
+					auto& g = Generation[i];
+					memcpy(Scratch.data(), &Elite[g.Parent * ModelSize], ModelSize * sizeof(float));
+					ApplyMutation(Scratch.data(), g.Seeds.back());
+					Memcpy(Model, Scratch.data());
+					g.Error = ErrorFunction();
 				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock{ FailLock };
+				if (!Failed) Failed = std::current_exception();
+				Next = Population;
 			}
+		};
+		std::vector<std::thread> Workers;
+		for (auto& r : Replicas)
+			Workers.emplace_back([&Worker, &r] { Worker(r.ErrorFunction, r.Model); });
+		Worker(ErrorFnc, Updater);
+		for (auto& w : Workers) w.join();
+		if (Failed) std::rethrow_exception(Failed);
+
+		int Keep = std::min(Survive, Population);
+		std::partial_sort(Generation.begin(), Generation.begin() + Keep, Generation.end(), [](auto& a, auto& b) { return a.Error < b.Error; });
+		NextElite.resize(size_t(Keep) * ModelSize);
+		for (auto k = 0; k < Keep; k++) {
+			float* dst = &NextElite[k * ModelSize];
+			memcpy(dst, &Elite[Generation[k].Parent * ModelSize], ModelSize * sizeof(float));
+			if (Generation[k].Mutated) ApplyMutation(dst, Generation[k].Seeds.back());
 		}
+		std::swap(Elite, NextElite);
+		Survived.assign(Generation.begin(), Generation.begin() + Keep);
+		GenId++;
+		return Survived[0].Error;
+	}
+
+	float SeedGeneticSolver::Update() {
+		Memcpy(Updater, Elite.data());
+		return Survived[0].Error;
 	}
 }
\ No newline at end of file
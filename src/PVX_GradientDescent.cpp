@@ -1,4 +1,8 @@
 #include <PVX_Solvers.h>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <mutex>
 
 namespace PVX::Solvers {
 
@@ -28,37 +32,83 @@ namespace PVX::Solvers {
 	) : GradientDescent(ErrorFunction, { {Model, ModelSize} }, LearnRate, Momentum, RMSprop) {}
 
 
-	void ForEach(std::vector<std::pair<float*, size_t>>& Model, std::function<void(float&)> fnc) {
+	template<typename F>
+	static void ForEach(std::vector<std::pair<float*, size_t>>& Model, size_t Start, size_t End, F&& fnc) {
+		size_t Offset = 0;
 		for (auto [w, sz] : Model) {
-			for (auto i = 0; i<sz; i++) {
-				fnc(w[i]);
+			if (Start >= End) return;
+			if (Start < Offset + sz) {
+				size_t e = std::min(End, Offset + sz);
+				for (size_t i = Start; i < e; i++)
+					fnc(w[i - Offset], i);
+				Start = e;
 			}
+			Offset += sz;
 		}
 	}
 
-	float GradientDescent::Iterate(float dx) {
-		size_t c = 0;
-		ForEach(Updater, [&](float& w) {
-			float save = w;
-			w += dx;
-			float nError = ErrorFnc();
-			vGradient[c++] = (Error - nError)/dx;
-			w = save;
+	void GradientDescent::Gradient(float dx) {
+		auto Work = [&](std::function<float()>& ErrorFunction, std::vector<std::pair<float*, size_t>>& Model, size_t Start, size_t End) {
+			ForEach(Model, Start, End, [&](float& w, size_t c) {
+				float save = w;
+				w += dx;
+				float nError = ErrorFunction();
+				vGradient[c] = (Error - nError)/dx;
+				w = save;
+			});
+		};
+		if (Replicas.empty()) {
+			Work(ErrorFnc, Updater, 0, ModelSize);
+			return;
+		}
+
+		Memcpy(Current.data(), Updater);
+		std::atomic<size_t> Next = 0;
+		const size_t Chunk = std::max(size_t(1), ModelSize / ((Replicas.size() + 1) * 16));
+		RunWorkers([&](size_t Index, std::function<float()>& ErrorFunction, std::vector<std::pair<float*, size_t>>& Model) {
+			if (Index) Memcpy(Model, Current.data());
+			for (size_t Start; (Start = Next.fetch_add(Chunk)) < ModelSize;)
+				Work(ErrorFunction, Model, Start, std::min(Start + Chunk, ModelSize));
 		});
+	}
+
+	void GradientDescent::RunWorkers(const std::function<void(size_t, std::function<float()>&, std::vector<std::pair<float*, size_t>>&)>& Task) {
+		std::exception_ptr Failed;
+		std::mutex FailLock;
+		auto Worker = [&](size_t Index, std::function<float()>& ErrorFunction, std::vector<std::pair<float*, size_t>>& Model) {
+			try {
+				Task(Index, ErrorFunction, Model);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock{ FailLock };
+				if (!Failed) Failed = std::current_exception();
+			}
+		};
+		std::vector<std::thread> Workers;
+		for (size_t i = 0; i < Replicas.size(); i++)
+			Workers.emplace_back([&, i] { Worker(i + 1, Replicas[i].ErrorFunction, Replicas[i].Model); });
+		Worker(0, ErrorFnc, Updater);
+		for (auto& w : Workers) w.join();
+		if (Failed) std::rethrow_exception(Failed);
+	}
+
+	float GradientDescent::Iterate(float dx) {
+		Gradient(dx);
 
-		for (auto i = 0; i<vGradient.size(); i++) {
-			float& g = vGradient[i];
-			float& rms = vRMSprop[i];
-			rms = RMSprop * rms + iRMSprop * g*g;
-			g /= sqrtf(rms+1e-8f);
-			vMomentum[i] = vMomentum[i] * Momentum + LearnRate * g;
+		const float* g = vGradient.data();
+		float* rms = vRMSprop.data();
+		float* m = vMomentum.data();
+		for (size_t i = 0; i < ModelSize; i++) {
+			rms[i] = RMSprop * rms[i] + iRMSprop * g[i] * g[i];
+			m[i] = m[i] * Momentum + LearnRate * g[i] / sqrtf(rms[i] + 1e-8f);
+		}
+
+		size_t c = 0;
+		for (auto [w, sz] : Updater) {
+			for (size_t i = 0; i < sz; i++)
+				w[i] += m[c + i];
+			c += sz;
 		}
 
-		c = 0;
-		ForEach(Updater, [&](float& w) {
-			w += vMomentum[c++];
-		});
-		
 		Error = ErrorFnc();
 		if (Error<LastError) {
 			ClearMomentum();
@@ -101,4 +151,91 @@ namespace PVX::Solvers {
 		iRMSprop{ 1.0f - RMSprop },
 		Error{ ErrorFunction() }
 	{ LastError = Error; }
+
+	GradientDescent::GradientDescent(
+		std::function<Replica()> MakeReplica, int Threads,
+		float LearnRate, float Momentum, float RMSprop
+	) : GradientDescent(MakeReplica(), LearnRate, Momentum, RMSprop) {
+		if (Threads <= 0) Threads = std::max(1u, std::thread::hardware_concurrency());
+		Threads = int(std::min(size_t(Threads), std::max(size_t(1), ModelSize)));
+		for (int i = 1; i < Threads; i++) {
+			Replicas.push_back(MakeReplica());
+			if (GetModelSize(Replicas.back().Model) != ModelSize) throw "Replica model size mismatch";
+		}
+		Current.resize(ModelSize);
+	}
+
+	static void Perturb(std::vector<std::pair<float*, size_t>>& Model, const float* Base, const signed char* Sign, float d) {
+		for (auto [w, sz] : Model) {
+			for (size_t i = 0; i < sz; i++)
+				w[i] = Base[i] + d * Sign[i];
+			Base += sz;
+			Sign += sz;
+		}
+	}
+
+	void SPSA::Gradient(float dx) {
+		Memcpy(Current.data(), Updater);
+		std::atomic<int> Next = 0;
+		RunWorkers([&](size_t Index, std::function<float()>& ErrorFunction, std::vector<std::pair<float*, size_t>>& Model) {
+			float* acc = Accum[Index].data();
+			signed char* sign = Signs[Index].data();
+			std::fill(acc, acc + ModelSize, 0.0f);
+			for (int k; (k = Next++) < Draws;) {
+				std::mt19937_64 rng(Seed + Step * Draws + k);
+				for (size_t i = 0; i < ModelSize; i += 64) {
+					auto bits = rng();
+					for (size_t j = 0; j < 64 && i + j < ModelSize; j++)
+						sign[i + j] = (bits >> j) & 1 ? 1 : -1;
+				}
+				Perturb(Model, Current.data(), sign, dx);
+				float Plus = ErrorFunction();
+				Perturb(Model, Current.data(), sign, -dx);
+				float Minus = ErrorFunction();
+				float g = (Minus - Plus) / (2.0f * dx * Draws);
+				for (size_t i = 0; i < ModelSize; i++)
+					acc[i] += g * sign[i];
+			}
+			if (!Index) Memcpy(Model, Current.data());
+		});
+		Step++;
+		vGradient = Accum[0];
+		for (size_t t = 1; t < Accum.size(); t++) {
+			const float* acc = Accum[t].data();
+			for (size_t i = 0; i < ModelSize; i++)
+				vGradient[i] += acc[i];
+		}
+	}
+
+	SPSA::SPSA(
+		std::function<float()> ErrorFunction,
+		std::vector<std::pair<float*, size_t>> Model,
+		int Draws,
+		float LearnRate, float Momentum, float RMSprop,
+		uint64_t Seed
+	) : GradientDescent(ErrorFunction, Model, LearnRate, Momentum, RMSprop),
+		Draws{ std::max(1, Draws) },
+		Seed{ Seed },
+		Accum(1, std::vector<float>(ModelSize)),
+		Signs(1, std::vector<signed char>(ModelSize))
+	{ Current.resize(ModelSize); }
+
+	SPSA::SPSA(
+		std::function<float()> ErrorFunction,
+		float* Model, size_t ModelSize,
+		int Draws,
+		float LearnRate, float Momentum, float RMSprop,
+		uint64_t Seed
+	) : SPSA(ErrorFunction, { {Model, ModelSize} }, Draws, LearnRate, Momentum, RMSprop, Seed) {}
+
+	SPSA::SPSA(
+		std::function<Replica()> MakeReplica, int Draws, int Threads,
+		float LearnRate, float Momentum, float RMSprop,
+		uint64_t Seed
+	) : GradientDescent(MakeReplica, std::min(Threads > 0 ? Threads : int(std::max(1u, std::thread::hardware_concurrency())), std::max(1, Draws)), LearnRate, Momentum, RMSprop),
+		Draws{ std::max(1, Draws) },
+		Seed{ Seed },
+		Accum(Replicas.size() + 1, std::vector<float>(ModelSize)),
+		Signs(Replicas.size() + 1, std::vector<signed char>(ModelSize))
+	{}
 }
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include <PVX_Solvers.h>
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <mutex>
+
+namespace PVX::Solvers {
+	bool IslandSolver::Mailbox::Push(const float* Model, float Error, size_t ModelSize) {
+		auto t = Tail.load(std::memory_order_relaxed);
+		if (t - Head.load(std::memory_order_acquire) >= Capacity) return false;
+		memcpy(&Models[(t % Capacity) * ModelSize], Model, ModelSize * sizeof(float));
+		Errors[t % Capacity] = Error;
+		Tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	bool IslandSolver::Mailbox::Pop(float* Model, float& Error, size_t ModelSize) {
+		auto h = Head.load(std::memory_order_relaxed);
+		if (h == Tail.load(std::memory_order_acquire)) return false;
+		memcpy(Model, &Models[(h % Capacity) * ModelSize], ModelSize * sizeof(float));
+		Error = Errors[h % Capacity];
+		Head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	IslandSolver::IslandSolver(
+		std::function<ModelReplica()> MakeReplica,
+		int nIslands,
+		int Population,
+		int Survive,
+		float MutationVariance,
+		float MutateProbability,
+		float Combine,
+		uint64_t Seed)
+	{
+		if (nIslands <= 0) nIslands = std::max(1u, std::thread::hardware_concurrency());
+		for (auto i = 0; i < nIslands; i++) {
+			auto& isl = Islands.emplace_back(std::make_unique<Island>());
+			isl->Solver = std::make_unique<GeneticSolver>(MakeReplica, 1, Population, Survive, MutationVariance, MutateProbability, Combine);
+			isl->Solver->SetSeed(Seed + i);
+		}
+		ModelSize = Islands[0]->Solver->ModelSize;
+		for (auto& isl : Islands)
+			if (isl->Solver->ModelSize != ModelSize) throw "Replica model size mismatch";
+
+		// Every island's Generation and Survived models live in one pool, each island on its own cache lines
+		size_t Used = Islands[0]->Solver->Memory.size();
+		size_t Stride = (Used + 15) & ~size_t(15);
+		Pool.resize(Stride * Islands.size() + 15);
+		float* Base = Pool.data() + ((16 - (reinterpret_cast<uintptr_t>(Pool.data()) / sizeof(float)) % 16) % 16);
+		for (size_t i = 0; i < Islands.size(); i++) {
+			auto& s = *Islands[i]->Solver;
+			float* Slice = Base + i * Stride;
+			memcpy(Slice, s.Memory.data(), Used * sizeof(float));
+			for (auto* g : { &s.Generation, &s.Survived })
+				for (auto& e : *g) e.Model = Slice + (e.Model - s.Memory.data());
+			std::vector<float>().swap(s.Memory);
+
+			auto& Inbox = Islands[i]->Inbox;
+			Inbox.Capacity = std::max(size_t(Survive), size_t(1));
+			Inbox.Models.resize(Inbox.Capacity * ModelSize);
+			Inbox.Errors.resize(Inbox.Capacity);
+		}
+	}
+
+	void IslandSolver::Migrate(size_t Index) {
+		auto& s = *Islands[Index]->Solver;
+		auto& Next = Islands[(Index + 1) % Islands.size()]->Inbox;
+		int Count = std::min(Migrants, s.Survive);
+		for (auto i = 0; i < Count; i++)
+			if (!Next.Push(s.Survived[i].Model, s.Survived[i].Error, ModelSize)) break;
+
+		auto& Inbox = Islands[Index]->Inbox;
+		std::vector<float> Incoming(ModelSize);
+		float Error;
+		for (int Slot = s.Survive - 1; Slot >= 0 && Inbox.Pop(Incoming.data(), Error, ModelSize); Slot--) {
+			auto& dst = s.Survived[Slot];
+			if (Error >= dst.Error) continue;
+			memcpy(dst.Model, Incoming.data(), ModelSize * sizeof(float));
+			dst.Error = Error;
+		}
+		auto Best = std::min_element(s.Survived.begin(), s.Survived.end(), [](auto& a, auto& b) { return a.Error < b.Error; });
+		std::swap(*Best, s.Survived[0]);
+	}
+
+	float IslandSolver::Run(int Generations) {
+		std::exception_ptr Failed;
+		std::mutex FailLock;
+		std::vector<std::thread> Workers;
+		for (size_t i = 0; i < Islands.size(); i++) {
+			Workers.emplace_back([&, i] {
+				try {
+					auto& s = *Islands[i]->Solver;
+					for (auto g = 0; g < Generations; g++) {
+						s.IterateGeneration();
+						if (Islands.size() > 1 && MigrationInterval > 0 && (s.GenId + 1) % MigrationInterval == 0)
+							Migrate(i);
+					}
+				} catch (...) {
+					std::lock_guard<std::mutex> lock{ FailLock };
+					if (!Failed) Failed = std::current_exception();
+				}
+			});
+		}
+		for (auto& w : Workers) w.join();
+		if (Failed) std::rethrow_exception(Failed);
+		return Islands[BestIsland()]->Solver->Survived[0].Error;
+	}
+
+	int IslandSolver::BestIsland() {
+		int Best = 0;
+		for (auto i = 1; i < int(Islands.size()); i++)
+			if (Islands[i]->Solver->Survived[0].Error < Islands[Best]->Solver->Survived[0].Error)
+				Best = i;
+		return Best;
+	}
+
+	float IslandSolver::GetBest(float* Model) {
+		auto& s = *Islands[BestIsland()]->Solver;
+		memcpy(Model, s.Survived[0].Model, ModelSize * sizeof(float));
+		return s.Survived[0].Error;
+	}
+}
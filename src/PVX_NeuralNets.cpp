@@ -1,6 +1,7 @@
 #include <PVX_NeuralNetsCPU.h>
 #include <iostream>
 #include "PVX_NeuralNets_Util.inl"
+#include "PVX_Compat.h"
 
 namespace PVX::DeepNeuralNets {
 	extern int UseDropout;
@@ -13,7 +14,9 @@ namespace PVX::DeepNeuralNets {
 	float NeuralLayer_Base::__iDropout = 1.0f / 0.8f;
 	float NeuralLayer_Base::__L2 = 0.0f;
 	int NeuralLayer_Base::OverrideOnLoad = 0;
-	size_t NeuralLayer_Base::NextId = 0;
+	WeightEncoding NeuralLayer_Base::SaveEncoding = WeightEncoding::Float32;
+	std::atomic<size_t> NeuralLayer_Base::NextId{ 0 };
+	int NeuralLayer_Base::Profiling = 0;
 
 	netData myRandom(int r, int c, float Max) {
 		return Max * netData::Random(r, c);
@@ -72,9 +75,19 @@ namespace PVX::DeepNeuralNets {
 	void NeuralLayer_Base::UseDropout(int b) {
 		PVX::DeepNeuralNets::UseDropout = b;
 	}
+	void NeuralLayer_Base::EnableProfiling(int b) {
+		Profiling = b;
+	}
+	void NeuralLayer_Base::Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const {
+		Flops = 0;
+		Bytes = Stage == ProfileStage::UpdateWeights ? 0 : 8.0 * output.rows() * Columns;
+	}
 	void NeuralLayer_Base::OverrideParamsOnLoad(int b) {
 		OverrideOnLoad = b;
 	}
+	void NeuralLayer_Base::SaveWeightsAs(WeightEncoding Encoding) {
+		SaveEncoding = Encoding;
+	}
 
 	void NeuralLayer_Base::SetLearnRate(float Beta) {
 		if (PreviousLayer)PreviousLayer->SetLearnRate(Beta);
@@ -96,6 +96,7 @@ namespace PVX {
 
 		void ActivationLayer::FeedForward(int64_t Version) {
 			if (Version > FeedVersion) {
+				ProfileScope Scope(this, ProfileStage::FeedForward);
 				PreviousLayer->FeedForward(Version);
 				//const auto& inp = PreviousLayer->Output();
 				//if (inp.cols() != output.cols()) {
@@ -116,6 +117,7 @@ namespace PVX {
 			}
 			if (Index > FeedIndexVersion) {
 				FeedIndexVersion = Index;
+				ProfileScope Scope(this, ProfileStage::FeedForward, 1);
 				PreviousLayer->FeedForward(Version, Index);
 				const auto& pro = PreviousLayer->Output();
 				if (pro.cols() != output.cols()) {
@@ -128,20 +130,56 @@ namespace PVX {
 				output(output.rows() - 1, Index) = 1.0f;
 			}
 		}
+		void ActivationLayer::Infer(InferenceSession& s) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				PreviousLayer->Infer(s);
+				st.output = Activate(s.State(PreviousLayer).output);
+				st.output.row(st.output.rows() - 1) = netData::Ones(1, st.output.cols());
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = st.output.cols();
+			}
+		}
+		void ActivationLayer::Infer(InferenceSession& s, int64_t Index) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = -1;
+			}
+			if (Index > st.FeedIndexVersion) {
+				st.FeedIndexVersion = Index;
+				PreviousLayer->Infer(s, Index);
+				const auto& pro = s.State(PreviousLayer).output;
+				if (pro.cols() != st.output.cols()) {
+					st.output = netData::Ones(st.output.rows(), pro.cols());
+				}
+				st.output.col(Index) = Activate(pro.col(Index));
+				st.output(st.output.rows() - 1, Index) = 1.0f;
+			}
+		}
 		void ActivationLayer::BackPropagate(const netData& Gradient) {
+			ProfileScope Scope(this, ProfileStage::BackPropagate, Gradient.cols());
 			netData grad = Gradient.array() * Derivative(outPart(output)).array();
 			PreviousLayer->BackPropagate(grad);
 		}
 
 		void ActivationLayer::BackPropagate(const netData& Gradient, int64_t Index) {
+			ProfileScope Scope(this, ProfileStage::BackPropagate, 1);
 			netData grad = Gradient.array() * Derivative(outPart(output, Index)).array();
 			PreviousLayer->BackPropagate(grad, Index);
 		}
 
 		void ActivationLayer::UpdateWeights() {
+			ProfileScope Scope(this, ProfileStage::UpdateWeights);
 			PreviousLayer->UpdateWeights();
 		}
 
+		void ActivationLayer::Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const {
+			double Size = double(output.rows()) * Columns;
+			Flops = Stage == ProfileStage::UpdateWeights ? 0 : 2.0 * Size;
+			Bytes = Stage == ProfileStage::FeedForward ? 8.0 * Size : Stage == ProfileStage::BackPropagate ? 12.0 * Size : 0;
+		}
+
 		void ActivationLayer::Save(PVX::BinSaver& bin, const std::map<NeuralLayer_Base*, size_t>& IndexOf) const {
 			bin.Begin("ACTV");
 			{
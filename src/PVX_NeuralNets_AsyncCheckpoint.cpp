@@ -0,0 +1,64 @@
+#include <PVX_NeuralNetsCPU.h>
+
+namespace PVX::DeepNeuralNets {
+	AsyncCheckpoint::AsyncCheckpoint(NetContainer& Net, std::function<void(const std::wstring&, int64_t, int)> OnSaved) :
+		Net{ Net },
+		OnSaved{ OnSaved },
+		Slots{ std::make_unique<NetContainer>(Net), std::make_unique<NetContainer>(Net) }
+	{
+		Worker = std::thread([this] { Run(); });
+	}
+
+	AsyncCheckpoint::~AsyncCheckpoint() {
+		{
+			std::lock_guard<std::mutex> lk(Lock);
+			Running = false;
+		}
+		Signal.notify_all();
+		Worker.join();
+	}
+
+	void AsyncCheckpoint::Save(const std::wstring& Filename, int64_t Step) {
+		std::lock_guard<std::mutex> lk(Lock);
+		if (Pending < 0) Pending = Writing == 0 ? 1 : 0;
+		Slots[Pending]->CopyStateFrom(Net);
+		PendingFilename = Filename;
+		PendingStep = Step;
+		Signal.notify_one();
+	}
+
+	void AsyncCheckpoint::Wait() {
+		std::unique_lock<std::mutex> lk(Lock);
+		IdleSignal.wait(lk, [this] { return Pending < 0 && Writing < 0; });
+	}
+
+	void AsyncCheckpoint::Run() {
+		std::unique_lock<std::mutex> lk(Lock);
+		while (true) {
+			Signal.wait(lk, [this] { return !Running || Pending >= 0; });
+			if (Pending < 0) return;
+			Writing = Pending;
+			Pending = -1;
+			auto Filename = PendingFilename;
+			auto Step = PendingStep;
+			lk.unlock();
+
+			auto tmp = Filename + L".tmp";
+			int ok;
+			try {
+				PVX::BinSaver bin(tmp.c_str(), "NWK2");
+				bin.Sync();
+				Slots[Writing]->Save(bin, 1);
+				ok = bin.Save();
+			} catch (...) {
+				ok = 0;
+			}
+			ok = ok && PVX::RenameFile(tmp.c_str(), Filename.c_str());
+			if (OnSaved) OnSaved(Filename, Step, ok);
+
+			lk.lock();
+			Writing = -1;
+			IdleSignal.notify_all();
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#include <PVX_NeuralNetsCPU.h>
+
+namespace PVX::DeepNeuralNets {
+	AsyncEvaluator::AsyncEvaluator(NetContainer& Net, const netData& Input, const netData& Output, std::function<void(float, int64_t)> OnResult, size_t Threads, size_t BatchSize) :
+		Net{ Net },
+		Input{ Net.MakeRawInput(Input) },
+		Output{ Output },
+		BatchSize{ BatchSize },
+		OnResult{ OnResult },
+		Best{ std::make_unique<NetContainer>(Net) },
+		Saving{ std::make_unique<NetContainer>(Net) }
+	{
+		for (size_t i = 0; i < Threads * 2; i++) {
+			Replicas.push_back(std::make_unique<NetContainer>(Net));
+			Idle.push_back(Replicas.back().get());
+		}
+		for (size_t i = 0; i < Threads; i++)
+			Workers.emplace_back([this] { Run(); });
+	}
+
+	AsyncEvaluator::~AsyncEvaluator() {
+		{
+			std::lock_guard<std::mutex> lk(Lock);
+			Running = false;
+		}
+		Signal.notify_all();
+		for (auto& w : Workers) w.join();
+	}
+
+	void AsyncEvaluator::KeepBest(const std::wstring& Filename) {
+		std::lock_guard<std::mutex> lk(Lock);
+		BestFilename = Filename;
+	}
+
+	void AsyncEvaluator::Evaluate(int64_t Step) {
+		NetContainer* rep;
+		{
+			std::unique_lock<std::mutex> lk(Lock);
+			IdleSignal.wait(lk, [this] { return Idle.size() > 0; });
+			rep = Idle.back();
+			Idle.pop_back();
+		}
+		rep->CopyWeightsFrom(Net);
+		{
+			std::lock_guard<std::mutex> lk(Lock);
+			Jobs.push_back({ rep, Step });
+		}
+		Signal.notify_one();
+	}
+
+	void AsyncEvaluator::Wait() {
+		std::unique_lock<std::mutex> lk(Lock);
+		IdleSignal.wait(lk, [this] { return Idle.size() == Replicas.size(); });
+	}
+
+	void AsyncEvaluator::Run() {
+		std::unique_lock<std::mutex> lk(Lock);
+		while (true) {
+			Signal.wait(lk, [this] { return !Running || Jobs.size(); });
+			if (Jobs.empty()) return;
+			auto job = Jobs.front();
+			Jobs.pop_front();
+			lk.unlock();
+
+			float err = job.Replica->ErrorRaw(Input, Output, BatchSize);
+			if (OnResult) {
+				std::lock_guard<std::mutex> rlk(ResultLock);
+				OnResult(err, job.Step);
+			}
+
+			lk.lock();
+			bool Improved = bestStep < 0 || err < bestError;
+			if (Improved) {
+				bestError = err;
+				bestStep = job.Step;
+				Best->CopyWeightsFrom(*job.Replica);
+				Best->error = err;
+				BestVersion++;
+			}
+			Idle.push_back(job.Replica);
+			IdleSignal.notify_all();
+			if (Improved && BestFilename.size()) {
+				lk.unlock();
+				SaveBest();
+				lk.lock();
+			}
+		}
+	}
+
+	void AsyncEvaluator::SaveBest() {
+		std::lock_guard<std::mutex> slk(SaveLock);
+		std::wstring Filename;
+		{
+			std::lock_guard<std::mutex> lk(Lock);
+			if (SavedVersion >= BestVersion) return;
+			SavedVersion = BestVersion;
+			Saving->CopyWeightsFrom(*Best);
+			Saving->error = Best->error;
+			Filename = BestFilename;
+		}
+		Saving->Save(Filename);
+	}
+
+	float AsyncEvaluator::BestError() {
+		std::lock_guard<std::mutex> lk(Lock);
+		return bestError;
+	}
+	int64_t AsyncEvaluator::BestStep() {
+		std::lock_guard<std::mutex> lk(Lock);
+		return bestStep;
+	}
+	void AsyncEvaluator::RestoreBest() {
+		std::lock_guard<std::mutex> lk(Lock);
+		Net.CopyWeightsFrom(*Best);
+	}
+}
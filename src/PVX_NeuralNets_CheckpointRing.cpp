@@ -0,0 +1,86 @@
+#include <PVX_NeuralNetsCPU.h>
+
+namespace PVX::DeepNeuralNets {
+	static void XorInto(const float* a, const float* b, float* Out, size_t Count) {
+		for (size_t i = 0; i < Count; i++) {
+			uint32_t x, y;
+			memcpy(&x, a + i, sizeof(uint32_t));
+			memcpy(&y, b + i, sizeof(uint32_t));
+			x ^= y;
+			memcpy(Out + i, &x, sizeof(uint32_t));
+		}
+	}
+
+	CheckpointRing::CheckpointRing(NetContainer& Net, size_t Capacity, size_t KeyframeInterval) :
+		Net{ Net },
+		DNA{ Net.GetDNA() },
+		Capacity{ std::max(Capacity, size_t(1)) },
+		KeyframeInterval{ std::max(KeyframeInterval, size_t(1)) }
+	{}
+
+	void CheckpointRing::Decode(size_t Index, std::vector<float>& Out) const {
+		size_t k = Index;
+		while (!Ring[k].Keyframe) k--;
+		Out.resize(DNA.Size);
+		memcpy(Out.data(), Ring[k].Data.data(), DNA.Size * sizeof(float));
+		std::vector<float> Delta(DNA.Size);
+		for (k++; k <= Index; k++) {
+			DecodeWeights(Ring[k].Data.data(), Ring[k].Data.size(), WeightEncoding::ShuffleLZ, Delta.data(), Delta.size());
+			XorInto(Out.data(), Delta.data(), Out.data(), Out.size());
+		}
+	}
+
+	void CheckpointRing::Save(int64_t Step) {
+		DNA.GetData(Scratch);
+		Snapshot s{ Step, Net.error, 0, {} };
+		size_t SinceKey = 0;
+		for (auto i = Ring.size(); i > 0 && !Ring[i - 1].Keyframe; i--) SinceKey++;
+		if (Ring.empty() || SinceKey + 1 >= KeyframeInterval) {
+			s.Keyframe = 1;
+			s.Data.resize(Scratch.size() * sizeof(float));
+			memcpy(s.Data.data(), Scratch.data(), s.Data.size());
+		} else {
+			XorInto(Scratch.data(), Latest.data(), Latest.data(), Latest.size());
+			s.Data = EncodeWeights(Latest.data(), Latest.size(), WeightEncoding::ShuffleLZ);
+		}
+		Latest.swap(Scratch);
+
+		if (Ring.size() == Capacity) {
+			if (Ring.size() > 1 && !Ring[1].Keyframe) {
+				std::vector<float> Promoted;
+				Decode(1, Promoted);
+				Ring[1].Keyframe = 1;
+				Ring[1].Data.resize(Promoted.size() * sizeof(float));
+				memcpy(Ring[1].Data.data(), Promoted.data(), Ring[1].Data.size());
+			}
+			Ring.pop_front();
+		}
+		Ring.push_back(std::move(s));
+	}
+
+	void CheckpointRing::Restore(size_t Back) {
+		if (Back >= Ring.size()) throw "Checkpoint index out of range";
+		size_t Index = Ring.size() - 1 - Back;
+		Decode(Index, Latest);
+		DNA.SetData(Latest.data());
+		Net.error = Ring[Index].Error;
+		Ring.resize(Index + 1);
+	}
+
+	size_t CheckpointRing::Size() const {
+		return Ring.size();
+	}
+	int64_t CheckpointRing::Step(size_t Back) const {
+		if (Back >= Ring.size()) throw "Checkpoint index out of range";
+		return Ring[Ring.size() - 1 - Back].Step;
+	}
+	float CheckpointRing::Error(size_t Back) const {
+		if (Back >= Ring.size()) throw "Checkpoint index out of range";
+		return Ring[Ring.size() - 1 - Back].Error;
+	}
+	size_t CheckpointRing::MemoryUsage() const {
+		size_t ret = (Latest.capacity() + Scratch.capacity()) * sizeof(float);
+		for (auto& s : Ring) ret += s.Data.capacity();
+		return ret;
+	}
+}
@@ -1,5 +1,6 @@
 #include <PVX_NeuralNetsCPU.h>
 #include <iostream>
+#include "PVX_NeuralNets_Util.inl"
 
 namespace PVX {
 	namespace DeepNeuralNets {
@@ -63,6 +64,7 @@ namespace PVX {
 		}
 		void NeuronCombiner::FeedForward(int64_t Version) {
 			if (Version > FeedVersion) {
+				ProfileScope Scope(this, ProfileStage::FeedForward);
 				InputLayers[0]->FeedForward(Version);
 				size_t Start = 0;
 				if (InputLayers[0]->BatchSize() != output.cols()) {
@@ -89,6 +91,7 @@ namespace PVX {
 			}
 			if (Index > FeedIndexVersion) {
 				FeedIndexVersion = Index;
+				ProfileScope Scope(this, ProfileStage::FeedForward, 1);
 				InputLayers[0]->FeedForward(Index, Version);
 				size_t Start = 0;
 				if (InputLayers[0]->BatchSize() != output.cols()) {
@@ -108,7 +111,45 @@ namespace PVX {
 			}
 		}
 
+		void NeuronCombiner::Infer(InferenceSession& s) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				size_t Start = 0;
+				for (auto i = 0; i < InputLayers.size(); i++) {
+					InputLayers[i]->Infer(s);
+					const auto& o = s.State(InputLayers[i]).output;
+					if (!i && o.cols() != st.output.cols()) {
+						st.output.conservativeResize(Eigen::NoChange, o.cols());
+					}
+					st.output.block(Start, 0, o.rows(), o.cols()) = o;
+					Start += o.rows() - 1;
+				}
+				st.FeedVersion = s.CurrentVersion();
+			}
+		}
+		void NeuronCombiner::Infer(InferenceSession& s, int64_t Index) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = -1;
+			}
+			if (Index > st.FeedIndexVersion) {
+				st.FeedIndexVersion = Index;
+				size_t Start = 0;
+				for (auto i = 0; i < InputLayers.size(); i++) {
+					InputLayers[i]->Infer(s, Index);
+					const auto& o = s.State(InputLayers[i]).output;
+					if (!i && o.cols() != st.output.cols()) {
+						st.output.conservativeResize(Eigen::NoChange, o.cols());
+					}
+					st.output.block(Start, Index, o.rows(), 1) = o.col(Index);
+					Start += o.rows() - 1;
+				}
+			}
+		}
+
 		void NeuronCombiner::BackPropagate(const netData & Gradient) {
+			ProfileScope Scope(this, ProfileStage::BackPropagate, Gradient.cols());
 			size_t Start = 0;
 			for (auto i : InputLayers) {
 				i->BackPropagate(Gradient.block(Start, 0, i->nOutput(), Gradient.cols()));
@@ -117,6 +158,7 @@ namespace PVX {
 		}
 
 		void NeuronCombiner::BackPropagate(const netData& Gradient, int64_t Index) {
+			ProfileScope Scope(this, ProfileStage::BackPropagate, 1);
 			size_t Start = 0;
 			for (auto i : InputLayers) {
 				i->BackPropagate(Gradient.block(Start, Index, i->nOutput(), 1), Index);
@@ -125,6 +167,7 @@ namespace PVX {
 		}
 
 		void NeuronCombiner::UpdateWeights() {
+			ProfileScope Scope(this, ProfileStage::UpdateWeights);
 			for (auto i: InputLayers) i->UpdateWeights();
 		}
 
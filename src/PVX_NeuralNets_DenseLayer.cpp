@@ -58,7 +58,7 @@ namespace PVX {
 
 		////////////////////////////////////
 
-		static int InitOpenMP = 0;
+		static std::once_flag InitOpenMP;
 		NeuronLayer::NeuronLayer(size_t nInput, size_t nOutput, LayerActivation Activation, TrainScheme Train) :
 			training{ Train },
 			activation{ Activation },
@@ -69,11 +69,29 @@ namespace PVX {
 			RMSprop{ netData::Ones(nOutput, nInput + 1ll) }
 			//RMSprop{ netDataArray::Zero(nOutput, nInput + 1ll) }
 		{
-			if (!InitOpenMP) {
+			Weights *= Setup(nInput, nOutput);
+		}
+
+		NeuronLayer::NeuronLayer(size_t nInput, size_t nOutput, LayerActivation Activation, TrainScheme Train, const float* View) :
+			training{ Train },
+			activation{ Activation },
+			WeightView{ View }
+		{
+			Setup(nInput, nOutput);
+			if (View) {
+				ViewCols = nInput + 1ll;
+			} else {
+				Weights.resize(nOutput, nInput + 1ll);
+				DeltaWeights = netData::Zero(nOutput, nInput + 1ll);
+				RMSprop = netData::Ones(nOutput, nInput + 1ll);
+			}
+		}
+
+		float NeuronLayer::Setup(size_t nInput, size_t nOutput) {
+			std::call_once(InitOpenMP, [] {
 				Eigen::initParallel();
 				Eigen::setNbThreads(8);
-				InitOpenMP = 1;
-			}
+			});
 			Id = ++NextId;
 
 			_LearnRate = __LearnRate;
@@ -88,7 +106,7 @@ namespace PVX {
 			float randScale = sqrtf(2.0f / (nInput + 1));
 
 			output = netData::Ones(nOutput + size_t(1), 1);
-			switch (Activation) {
+			switch (activation) {
 				case LayerActivation::Tanh:
 					randScale = sqrtf(1.0f / (nInput + 1));
 					Activate = Tanh;
@@ -113,9 +131,8 @@ namespace PVX {
 					Derivative = LinearDer;
 					break;
 			}
-			Weights *= randScale;
 			if (_L2>0.0f) {
-				switch (Train) {
+				switch (training) {
 					case TrainScheme::Adam: updateWeights = &NeuronLayer::Adam_L2_F; break;
 					case TrainScheme::RMSprop: updateWeights = &NeuronLayer::RMSprop_L2_F; break;
 					case TrainScheme::Momentum: updateWeights = &NeuronLayer::Momentum_L2_F; break;
@@ -123,7 +140,7 @@ namespace PVX {
 					case TrainScheme::Sgd: updateWeights = &NeuronLayer::Sgd_L2_F; break;
 				}
 			} else {
-				switch (Train) {
+				switch (training) {
 					case TrainScheme::Adam: updateWeights = &NeuronLayer::AdamF; break;
 					case TrainScheme::RMSprop: updateWeights = &NeuronLayer::RMSpropF; break;
 					case TrainScheme::Momentum: updateWeights = &NeuronLayer::MomentumF; break;
@@ -131,6 +148,7 @@ namespace PVX {
 					case TrainScheme::Sgd: updateWeights = &NeuronLayer::SgdF; break;
 				}
 			}
+			return randScale;
 		}
 
 		////////////////////////////////////
@@ -140,9 +158,18 @@ namespace PVX {
 			{
 				bin.Write("NDID", int(Id));
 				if (name.size()) bin.Write("NAME", name);
-				bin.Write("ROWS", int(Weights.rows()));
-				bin.Write("COLS", int(Weights.cols()));
-				bin.Write("WGHT", Weights.data(), Weights.size());
+				auto w = WeightsView();
+				bin.Write("ROWS", int(w.rows()));
+				bin.Write("COLS", int(w.cols()));
+				if (SaveEncoding == WeightEncoding::Float32) {
+					bin.Align(64, w.size() * sizeof(float) >= ~0u);
+					bin.Write("WGHT", w.data(), w.size());
+				} else {
+					bin.Begin("WENC"); {
+						bin.Write("TYPE", int(SaveEncoding));
+						bin.Write("DATA", EncodeWeights(w.data(), w.size(), SaveEncoding));
+					} bin.End();
+				}
 				bin.Write("RATE", _LearnRate);
 				bin.Write("MMNT", _Momentum);
 				bin.Write("RMSP", _RMSprop);
@@ -154,15 +181,24 @@ namespace PVX {
 			}
 			bin.End();
 		}
-		NeuralLayer_Base* NeuronLayer::Load2(PVX::BinLoader& bin) {
+		NeuralLayer_Base* NeuronLayer::Load2(PVX::BinLoader& bin, const char* Mapped) {
 			int rows = 0, cols = 0, act = 0, train = 0, prev = 0;
 			float rate, rms, drop, momentum;// , l2;
 			std::string Name;
 			int Id = -1;
 			std::vector<float> Weights;
+			std::vector<unsigned char> Encoded;
+			int Encoding = -1;
+			size_t WeightPos = 0;
 			bin.Read("ROWS", rows);
 			bin.Read("COLS", cols);
-			bin.Read("WGHT", Weights);
+			if (Mapped) bin.Process("WGHT", [&](PVX::BinLoader& bin2) { WeightPos = bin2.Position(); bin2.Skip(); });
+			else bin.Read("WGHT", Weights);
+			bin.Process("WENC", [&](PVX::BinLoader& bin2) {
+				bin2.Read("TYPE", Encoding);
+				bin2.Read("DATA", Encoded);
+				bin2.Execute();
+			});
 			bin.Read("RATE", rate);
 			bin.Read("MMNT", momentum);
 			bin.Read("RMSP", rms);
@@ -174,10 +210,22 @@ namespace PVX {
 			bin.Read("NAME", Name);
 			bin.Process("NDID", [&](PVX::BinLoader& bin2) { Id = bin2.read<int>(); });
 			bin.Execute();
-			auto ret = new NeuronLayer(cols-1, rows, LayerActivation(act), TrainScheme(train));
+			const float* View = nullptr;
+			if (Mapped && WeightPos && !(reinterpret_cast<uintptr_t>(Mapped + WeightPos) % alignof(float))) View = (const float*)(Mapped + WeightPos);
+			auto ret = new NeuronLayer(cols-1, rows, LayerActivation(act), TrainScheme(train), View);
 			if(Id >= 0) ret->Id = Id;
 			if (Name.size()) ret->name = Name;
-			ret->GetWeights() = Eigen::Map<netData>(Weights.data(), rows, cols);
+			if (Encoding >= 0) {
+				try {
+					DecodeWeights(Encoded.data(), Encoded.size(), WeightEncoding(Encoding), ret->Weights.data(), size_t(rows) * cols);
+				} catch (...) {
+					delete ret;
+					throw;
+				}
+			} else if (!View) {
+				if (Mapped) memcpy(ret->Weights.data(), Mapped + WeightPos, sizeof(float) * rows * cols);
+				else memcpy(ret->Weights.data(), Weights.data(), sizeof(float) * rows * cols);
+			}
 			if (!OverrideOnLoad) {
 				ret->_Dropout = drop;
 				ret->_iDropout = 1.0f / drop;
@@ -192,9 +240,9 @@ namespace PVX {
 			return ret;
 		}
 		NeuralLayer_Base* NeuronLayer::newCopy(const std::map<NeuralLayer_Base*,size_t>& IndexOf) {
-			auto ret = new NeuronLayer(nInput(), nOutput(), activation, training);
+			auto ret = new NeuronLayer(nInput(), nOutput(), activation, training, WeightView);
 
-			ret->Weights = Weights;
+			if (!WeightView) ret->Weights = Weights;
 			ret->_LearnRate = _LearnRate;
 			ret->_Momentum = _Momentum;
 			ret->_iMomentum = _iMomentum;
@@ -229,9 +277,15 @@ namespace PVX {
 		}
 
 		netData& NeuronLayer::GetWeights() {
+			if (WeightView) throw "Mapped layers are read-only";
 			return Weights;
 		}
 
+		Eigen::Map<const netData> NeuronLayer::WeightsView() const {
+			if (WeightView) return Eigen::Map<const netData>(WeightView, output.rows() - 1, ViewCols);
+			return Eigen::Map<const netData>(Weights.data(), Weights.rows(), Weights.cols());
+		}
+
 		NeuronLayer::NeuronLayer(const std::string& Name, size_t nInput, size_t nOutput, LayerActivation Activate, TrainScheme Train):
 			NeuronLayer(nInput, nOutput, Activate, Train) {
 			name = Name;
@@ -248,6 +302,7 @@ namespace PVX {
 		}
 		void NeuronLayer::FeedForward(int64_t Version) {
 			if (Version > FeedVersion) {
+				ProfileScope Scope(this, ProfileStage::FeedForward);
 				PreviousLayer->FeedForward(Version);
 				const auto& inp = PreviousLayer->Output();
 				if (inp.cols() != output.cols()) {
@@ -255,11 +310,11 @@ namespace PVX {
 				}
 				if (PVX::DeepNeuralNets::UseDropout && _Dropout < 1.0f) {
 					outPart(output) = 
-						Activate(Weights * inp).array() * 
+						Activate(WeightsView() * inp).array() * 
 						(RandomBias(output.rows() - 1ll, output.cols()) < _Dropout).cast<float>() * 
 						_iDropout;
 				} else {
-					outPart(output) = Activate(Weights * inp);
+					outPart(output) = Activate(WeightsView() * inp);
 				}
 				FeedVersion = Version;
 				FeedIndexVersion = output.cols();
@@ -273,6 +328,7 @@ namespace PVX {
 			}
 			if (Index > FeedIndexVersion) {
 				FeedIndexVersion = Index;
+				ProfileScope Scope(this, ProfileStage::FeedForward, 1);
 				PreviousLayer->FeedForward(Index, Version);
 				const auto& pro = PreviousLayer->Output();
 				if (pro.cols() != output.cols()) {
@@ -282,16 +338,49 @@ namespace PVX {
 
 				if (PVX::DeepNeuralNets::UseDropout && _Dropout < 1.0f) {
 					outPart(output, Index) =
-						Activate(Weights * inp).array() *
+						Activate(WeightsView() * inp).array() *
 						(RandomBias(output.rows() - 1ll, output.cols()) < _Dropout).cast<float>() *
 						_iDropout;
 				} else {
-					outPart(output, Index) = Activate(Weights * inp);
+					outPart(output, Index) = Activate(WeightsView() * inp);
 				}
 			}
 		}
 
+		void NeuronLayer::Infer(InferenceSession& s) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				PreviousLayer->Infer(s);
+				const auto& inp = s.State(PreviousLayer).output;
+				if (inp.cols() != st.output.cols()) {
+					st.output = netData::Ones(st.output.rows(), inp.cols());
+				}
+				outPart(st.output) = Activate(WeightsView() * inp);
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = st.output.cols();
+			}
+		}
+
+		void NeuronLayer::Infer(InferenceSession& s, int64_t Index) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = -1;
+			}
+			if (Index > st.FeedIndexVersion) {
+				st.FeedIndexVersion = Index;
+				PreviousLayer->Infer(s, Index);
+				const auto& pro = s.State(PreviousLayer).output;
+				if (pro.cols() != st.output.cols()) {
+					st.output = netData::Ones(st.output.rows(), pro.cols());
+				}
+				outPart(st.output, Index) = Activate(WeightsView() * pro.col(Index));
+			}
+		}
+
 		void NeuronLayer::BackPropagate(const netData & Gradient) {
+			if (WeightView) throw "Mapped layers are read-only";
+			ProfileScope Scope(this, ProfileStage::BackPropagate, Gradient.cols());
 			netData grad = Gradient.array() * Derivative(outPart(output)).array();
 			netData prop = Weights.transpose() * grad;
 			PreviousLayer->BackPropagate(outPart(prop));
@@ -304,6 +393,8 @@ namespace PVX {
 		}
 
 		void NeuronLayer::BackPropagate(const netData& Gradient, int64_t Index) {
+			if (WeightView) throw "Mapped layers are read-only";
+			ProfileScope Scope(this, ProfileStage::BackPropagate, 1);
 			netData grad = Gradient.array() * Derivative(outPart(output, Index)).array();
 			netData prop = Weights.transpose() * grad;
 			PreviousLayer->BackPropagate(outPart(prop), Index);
@@ -316,16 +407,46 @@ namespace PVX {
 		}
 
 		void NeuronLayer::UpdateWeights() {
+			if (WeightView) throw "Mapped layers are read-only";
+			ProfileScope Scope(this, ProfileStage::UpdateWeights, curGradient.cols());
 			(this->*updateWeights)(curGradient);
 			memset(curGradient.data(), 0, sizeof(float) * curGradient.size());
 		}
 
+		void NeuronLayer::Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const {
+			double In = double(nInput() + 1), Out = double(nOutput()), C = double(Columns);
+			switch (Stage) {
+				case ProfileStage::FeedForward:
+					Flops = 2.0 * Out * In * C + Out * C;
+					Bytes = 4.0 * (Out * In + In * C + Out * C);
+					break;
+				case ProfileStage::BackPropagate:
+					Flops = 2.0 * Out * In * C + 2.0 * Out * C;
+					Bytes = 4.0 * (Out * In + In * C + 3.0 * Out * C);
+					break;
+				case ProfileStage::UpdateWeights: {
+					double PerWeight = 2.0, Touched = 2.0;
+					switch (training) {
+						case TrainScheme::Adam: PerWeight = 9.0; Touched = 6.0; break;
+						case TrainScheme::RMSprop: PerWeight = 8.0; Touched = 6.0; break;
+						case TrainScheme::AdaGrad: PerWeight = 7.0; Touched = 4.0; break;
+						case TrainScheme::Momentum: PerWeight = 4.0; Touched = 4.0; break;
+						default: break;
+					}
+					Flops = 2.0 * Out * In * C + PerWeight * Out * In;
+					Bytes = 4.0 * (Out * C + In * C + Touched * Out * In);
+					break;
+				}
+			}
+		}
+
 		size_t NeuronLayer::nInput() const {
-			return Weights.cols() - 1;
+			return (WeightView ? ViewCols : Weights.cols()) - 1;
 		}
 
 		size_t NeuronLayer::DNA(std::map<void*, WeightData>& w) {
 			if (!w.count(this)) {
+				if (WeightView) throw "Mapped layers are read-only";
 				WeightData ret;
 				ret.Weights = Weights.data();
 				ret.Count = Weights.size();
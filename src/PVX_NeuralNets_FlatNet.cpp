@@ -0,0 +1,463 @@
+#include <PVX_NeuralNetsCPU.h>
+#include "PVX_Compat.h"
+#include <typeinfo>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+namespace PVX::DeepNeuralNets {
+	static size_t Align64(size_t x) {
+		return (x + 63) & ~size_t(63);
+	}
+
+	template<typename T>
+	static void Activate(T&& m, uint32_t Activation) {
+		switch (LayerActivation(Activation)) {
+			case LayerActivation::Tanh: m.array() = m.array().tanh(); break;
+			case LayerActivation::TanhBias: m.array() = m.array().tanh() * 0.5f + 0.5f; break;
+			case LayerActivation::ReLU: m.array() = m.array().max(0.0f); break;
+			case LayerActivation::Sigmoid: m.array() = 1.0f / (1.0f + (-m.array()).exp()); break;
+			case LayerActivation::Linear: break;
+		}
+	}
+
+	static void ApplyOutput(netData& output, uint32_t Type) {
+		switch (OutputType(Type)) {
+			case OutputType::MeanSquare:
+				break;
+			case OutputType::SoftMax:
+				output.array() = output.array().exp();
+				for (int64_t i = 0; i < output.cols(); i++) output.col(i) /= output.col(i).sum();
+				break;
+			case OutputType::StableSoftMax:
+				for (int64_t i = 0; i < output.cols(); i++) {
+					auto c = output.col(i);
+					c.array() = (c.array() - c.maxCoeff()).exp();
+					c /= c.sum();
+				}
+				break;
+		}
+	}
+
+	void NetContainer::ExportFlat(std::vector<unsigned char>& Output) {
+		BuildFlat(Output, nullptr);
+	}
+
+	void NetContainer::BuildFlat(std::vector<unsigned char>& Output, std::vector<const float*>* DenseWeights) {
+		if (RNNs.size()) throw "Recurrent networks cannot be exported as flat models";
+		std::vector<NeuralLayer_Base*> Order;
+		std::map<NeuralLayer_Base*, uint32_t> IndexOf;
+		std::function<void(NeuralLayer_Base*)> Visit = [&](NeuralLayer_Base* l) {
+			if (IndexOf.count(l)) return;
+			if (l->PreviousLayer) Visit(l->PreviousLayer);
+			for (auto i : l->InputLayers) Visit(i);
+			IndexOf[l] = uint32_t(Order.size());
+			Order.push_back(l);
+		};
+		Visit(LastLayer);
+
+		std::vector<FlatNet::Op> Ops;
+		std::vector<uint32_t> OpInputs;
+		std::vector<std::pair<const NeuronLayer*, uint64_t>> Dense;
+		uint64_t WeightCount = 0, ArenaRows = 0;
+		for (auto l : Order) {
+			FlatNet::Op o{};
+			o.Rows = uint32_t(l->nOutput());
+			o.InputStart = uint32_t(OpInputs.size());
+			o.ArenaOffset = ArenaRows;
+			ArenaRows += o.Rows + 1ll;
+			const auto& Type = typeid(*l);
+			if (Type == typeid(InputLayer)) {
+				o.Type = FlatNet::OpType::Input;
+				o.Activation = uint32_t(std::find(Inputs.begin(), Inputs.end(), l) - Inputs.begin());
+			} else if (Type == typeid(NeuronLayer)) {
+				auto d = static_cast<NeuronLayer*>(l);
+				o.Type = FlatNet::OpType::Dense;
+				o.Activation = uint32_t(d->activation);
+				o.WeightCols = uint32_t(d->nInput() + 1);
+				o.WeightOffset = WeightCount;
+				WeightCount += Align64(size_t(o.Rows) * o.WeightCols * sizeof(float)) / sizeof(float);
+				Dense.push_back({ d, o.WeightOffset });
+				if (DenseWeights) DenseWeights->push_back(d->Weights.data());
+				OpInputs.push_back(IndexOf.at(d->PreviousLayer));
+			} else if (Type == typeid(ActivationLayer)) {
+				o.Type = FlatNet::OpType::Activation;
+				o.Activation = uint32_t(static_cast<ActivationLayer*>(l)->activation);
+				OpInputs.push_back(IndexOf.at(l->PreviousLayer));
+			} else if (Type == typeid(NeuronAdder) || Type == typeid(NeuronMultiplier) || Type == typeid(NeuronCombiner)) {
+				o.Type = Type == typeid(NeuronAdder) ? FlatNet::OpType::Adder : Type == typeid(NeuronMultiplier) ? FlatNet::OpType::Multiplier : FlatNet::OpType::Combiner;
+				for (auto i : l->InputLayers) OpInputs.push_back(IndexOf.at(i));
+			} else
+				throw "Layer type not supported by flat export";
+			o.InputCount = uint32_t(OpInputs.size() - o.InputStart);
+			Ops.push_back(o);
+		}
+
+		FlatNet::Header h{};
+		h.Magic = TAG('P', 'V', 'X', 'F');
+		h.Version = 1;
+		h.OpCount = uint32_t(Ops.size());
+		h.InputCount = uint32_t(OpInputs.size());
+		h.Output = uint32_t(Type);
+		h.OpsOffset = Align64(sizeof(FlatNet::Header));
+		h.InputsOffset = h.OpsOffset + Ops.size() * sizeof(FlatNet::Op);
+		h.WeightsOffset = Align64(h.InputsOffset + OpInputs.size() * sizeof(uint32_t));
+		h.WeightCount = WeightCount;
+		h.ArenaRows = ArenaRows;
+		h.TotalSize = h.WeightsOffset + WeightCount * sizeof(float);
+
+		Output.assign(h.TotalSize, 0);
+		memcpy(Output.data(), &h, sizeof(h));
+		memcpy(Output.data() + h.OpsOffset, Ops.data(), Ops.size() * sizeof(FlatNet::Op));
+		if (OpInputs.size()) memcpy(Output.data() + h.InputsOffset, OpInputs.data(), OpInputs.size() * sizeof(uint32_t));
+		for (auto& [d, Offset] : Dense) {
+			auto w = d->WeightsView();
+			memcpy(Output.data() + h.WeightsOffset + Offset * sizeof(float), w.data(), w.size() * sizeof(float));
+		}
+	}
+
+	void NetContainer::ExportFlat(const std::wstring& Filename) {
+		std::vector<unsigned char> Data;
+		ExportFlat(Data);
+		FILE* fout;
+		if (_wfopen_s(&fout, Filename.c_str(), L"wb") || !fout) throw "Cannot create flat model file";
+		auto Written = fwrite(Data.data(), 1, Data.size(), fout);
+		fclose(fout);
+		if (Written != Data.size()) throw "Cannot write flat model file";
+	}
+
+	FlatNet::FlatNet(const std::wstring& Filename, int MapWeights) {
+		if (MapWeights) {
+			Mapping = std::make_shared<PVX::BinMapping>(Filename.c_str());
+			if (Mapping->OK()) {
+				Bind((const unsigned char*)Mapping->data(), Mapping->size());
+				return;
+			}
+			Mapping = nullptr;
+		}
+		FILE* fin;
+		if (_wfopen_s(&fin, Filename.c_str(), L"rb") || !fin) throw "Cannot open flat model file";
+		int64_t End = PVX::Seek64(fin, 0, SEEK_END) ? -1 : PVX::Tell64(fin);
+		if (End < 0 || PVX::Seek64(fin, 0, SEEK_SET)) {
+			fclose(fin);
+			throw "Cannot read flat model file";
+		}
+		size_t Size = size_t(End);
+		Owned.resize(Size + 64);
+		auto Data = Owned.data() + ((64 - (uintptr_t(Owned.data()) & 63)) & 63);
+		auto Read = fread(Data, 1, Size, fin);
+		fclose(fin);
+		if (Read != Size) throw "Cannot read flat model file";
+		Bind(Data, Size);
+	}
+
+	FlatNet::FlatNet(const unsigned char* Data, size_t Size) {
+		Bind(Data, Size);
+	}
+
+	void FlatNet::Bind(const unsigned char* Data, size_t Size) {
+		const char* Invalid = "Invalid flat model";
+		if (Size < sizeof(Header) || uintptr_t(Data) % alignof(uint64_t)) throw Invalid;
+		header = (const Header*)Data;
+		auto& h = *header;
+		if (h.Magic != TAG('P', 'V', 'X', 'F') || h.Version != 1 || !h.OpCount || h.TotalSize > Size) throw Invalid;
+		if (h.OpsOffset % alignof(uint64_t) || h.InputsOffset % alignof(uint32_t) || h.WeightsOffset % alignof(float)) throw Invalid;
+		if (h.OpsOffset + uint64_t(h.OpCount) * sizeof(Op) > h.TotalSize ||
+			h.InputsOffset + uint64_t(h.InputCount) * sizeof(uint32_t) > h.TotalSize ||
+			h.WeightsOffset + h.WeightCount * sizeof(float) > h.TotalSize) throw Invalid;
+		Ops = (const Op*)(Data + h.OpsOffset);
+		OpInputs = (const uint32_t*)(Data + h.InputsOffset);
+		Weights = (const float*)(Data + h.WeightsOffset);
+
+		for (uint32_t i = 0; i < h.OpCount; i++) {
+			auto& o = Ops[i];
+			if (uint64_t(o.InputStart) + o.InputCount > h.InputCount || o.ArenaOffset + o.Rows + 1 > h.ArenaRows) throw Invalid;
+			for (uint32_t j = 0; j < o.InputCount; j++)
+				if (OpInputs[o.InputStart + j] >= i) throw Invalid;
+			auto In = [&](uint32_t j) -> const Op& { return Ops[OpInputs[o.InputStart + j]]; };
+			switch (o.Type) {
+				case OpType::Input:
+					if (o.InputCount) throw Invalid;
+					if (InputOps.size() <= o.Activation) InputOps.resize(o.Activation + 1ll, nullptr);
+					InputOps[o.Activation] = &o;
+					break;
+				case OpType::Dense:
+					if (o.InputCount != 1 || o.WeightCols != In(0).Rows + 1 || o.WeightOffset + uint64_t(o.Rows) * o.WeightCols > h.WeightCount) throw Invalid;
+					break;
+				case OpType::Activation:
+					if (o.InputCount != 1 || In(0).Rows != o.Rows) throw Invalid;
+					break;
+				case OpType::Adder:
+				case OpType::Multiplier:
+					if (!o.InputCount) throw Invalid;
+					for (uint32_t j = 0; j < o.InputCount; j++) if (In(j).Rows != o.Rows) throw Invalid;
+					break;
+				case OpType::Combiner: {
+					uint64_t Rows = 0;
+					for (uint32_t j = 0; j < o.InputCount; j++) Rows += In(j).Rows;
+					if (Rows != o.Rows) throw Invalid;
+					break;
+				}
+				default:
+					throw Invalid;
+			}
+		}
+		if (InputOps.empty()) throw Invalid;
+		for (auto i : InputOps) if (!i) throw Invalid;
+	}
+
+	Eigen::Map<netData> FlatNet::Buffer(const Op& o) {
+		return Eigen::Map<netData>(Arena.data() + o.ArenaOffset * Batch, o.Rows + 1ll, Batch);
+	}
+
+	void FlatNet::Resize(int64_t Cols) {
+		if (Cols == Batch) return;
+		Batch = Cols;
+		Arena.resize(header->ArenaRows * Cols);
+		for (uint32_t i = 0; i < header->OpCount; i++)
+			Buffer(Ops[i]).bottomRows(1).setOnes();
+		output.resize(Ops[header->OpCount - 1].Rows, Cols);
+	}
+
+	void FlatNet::Run() {
+		for (uint32_t i = 0; i < header->OpCount; i++) {
+			auto& o = Ops[i];
+			auto out = Buffer(o);
+			auto top = out.topRows(o.Rows);
+			auto In = [&](uint32_t j) { return Buffer(Ops[OpInputs[o.InputStart + j]]); };
+			switch (o.Type) {
+				case OpType::Input:
+					break;
+				case OpType::Dense:
+					top.noalias() = Eigen::Map<const netData>(Weights + o.WeightOffset, o.Rows, o.WeightCols) * In(0);
+					Activate(top, o.Activation);
+					break;
+				case OpType::Activation:
+					top = In(0).topRows(o.Rows);
+					Activate(top, o.Activation);
+					break;
+				case OpType::Adder:
+					top = In(0).topRows(o.Rows);
+					for (uint32_t j = 1; j < o.InputCount; j++) top += In(j).topRows(o.Rows);
+					break;
+				case OpType::Multiplier:
+					top = In(0).topRows(o.Rows);
+					for (uint32_t j = 1; j < o.InputCount; j++) top.array() *= In(j).topRows(o.Rows).array();
+					break;
+				case OpType::Combiner: {
+					int64_t Start = 0;
+					for (uint32_t j = 0; j < o.InputCount; j++) {
+						auto rows = Ops[OpInputs[o.InputStart + j]].Rows;
+						out.middleRows(Start, rows) = In(j).topRows(rows);
+						Start += rows;
+					}
+					break;
+				}
+			}
+		}
+		auto& Last = Ops[header->OpCount - 1];
+		output = Buffer(Last).topRows(Last.Rows);
+		ApplyOutput(output, header->Output);
+	}
+
+	const netData& FlatNet::Process(const netData& inp) {
+		if (InputOps.size() != 1) throw "Input count mismatch";
+		if (inp.rows() != InputOps[0]->Rows) throw "Input size mismatch";
+		Resize(inp.cols());
+		Buffer(*InputOps[0]).topRows(InputOps[0]->Rows) = inp;
+		Run();
+		return output;
+	}
+	const netData& FlatNet::Process(const std::vector<netData>& inp) {
+		if (inp.size() != InputOps.size()) throw "Input count mismatch";
+		for (size_t i = 0; i < inp.size(); i++)
+			if (inp[i].rows() != InputOps[i]->Rows || inp[i].cols() != inp[0].cols()) throw "Input size mismatch";
+		Resize(inp[0].cols());
+		for (size_t i = 0; i < inp.size(); i++)
+			Buffer(*InputOps[i]).topRows(InputOps[i]->Rows) = inp[i];
+		Run();
+		return output;
+	}
+	std::vector<float> FlatNet::ProcessVec(const std::vector<float>& Inp) {
+		auto rows = InputOps[0]->Rows;
+		if (Inp.size() % rows) throw "Input size mismatch";
+		const auto& tmp = Process(Eigen::Map<const netData>(Inp.data(), rows, Inp.size() / rows));
+		std::vector<float> ret(tmp.size());
+		memcpy(ret.data(), tmp.data(), ret.size() * sizeof(float));
+		return ret;
+	}
+	size_t FlatNet::nInput(size_t Index) const {
+		return InputOps[Index]->Rows;
+	}
+	size_t FlatNet::nOutput() const {
+		return Ops[header->OpCount - 1].Rows;
+	}
+
+	PopulationEvaluator::PopulationEvaluator(NetContainer& Source, int Threads) :
+		Threads{ Threads > 0 ? Threads : int(std::max(1u, std::thread::hardware_concurrency())) }
+	{
+		std::vector<const float*> DenseWeights;
+		Source.BuildFlat(Blob, &DenseWeights);
+		Net = std::make_unique<FlatNet>(Blob.data(), Blob.size());
+
+		auto DNA = Source.GetDNA();
+		DNALength = DNA.Size;
+		std::map<const float*, size_t> OffsetOf;
+		for (auto& l : DNA.Layers) OffsetOf[l.Weights] = l.Offset;
+
+		auto& h = *Net->header;
+		DNAOffset.resize(h.OpCount);
+		Shared.resize(h.OpCount);
+		Stacked.resize(h.OpCount);
+		size_t DenseIndex = 0;
+		for (uint32_t i = 0; i < h.OpCount; i++) {
+			auto& o = Net->Ops[i];
+			if (o.Type == FlatNet::OpType::Dense) {
+				auto w = OffsetOf.find(DenseWeights[DenseIndex++]);
+				if (w == OffsetOf.end()) throw "Dense layer weights are not part of the network DNA";
+				DNAOffset[i] = w->second;
+				Stacked[i] = Shared[Net->OpInputs[o.InputStart]];
+			} else {
+				Shared[i] = 1;
+				for (uint32_t j = 0; j < o.InputCount; j++)
+					Shared[i] &= Shared[Net->OpInputs[o.InputStart + j]];
+			}
+		}
+	}
+
+	void PopulationEvaluator::Resize(int64_t nPopulation, int64_t nBatch) {
+		if (nPopulation == Population && nBatch == Batch) return;
+		Population = nPopulation;
+		Batch = nBatch;
+		auto& h = *Net->header;
+		Buffers.resize(h.OpCount);
+		for (uint32_t i = 0; i < h.OpCount; i++)
+			Buffers[i] = netData::Ones(Net->Ops[i].Rows + 1ll, Shared[i] ? Batch : Batch * Population);
+		output.resize(Population);
+	}
+
+	void PopulationEvaluator::RunOp(size_t Index, int64_t Candidate, const float* DNA) {
+		auto& o = Net->Ops[Index];
+		auto Block = [&](size_t op) { return Buffers[op].middleCols(Shared[op] ? 0 : Candidate * Batch, Batch); };
+		auto In = [&](uint32_t j) { return Block(Net->OpInputs[o.InputStart + j]); };
+		auto out = Block(Index);
+		auto top = out.topRows(o.Rows);
+		switch (o.Type) {
+			case FlatNet::OpType::Input:
+				break;
+			case FlatNet::OpType::Dense: {
+				Eigen::Map<const netData> w(DNA + DNAOffset[Index], o.Rows, o.WeightCols);
+				if (Batch == 1) top.col(0).noalias() = w * In(0).col(0);
+				else top.noalias() = w * In(0);
+				Activate(top, o.Activation);
+				break;
+			}
+			case FlatNet::OpType::Activation:
+				top = In(0).topRows(o.Rows);
+				Activate(top, o.Activation);
+				break;
+			case FlatNet::OpType::Adder:
+				top = In(0).topRows(o.Rows);
+				for (uint32_t j = 1; j < o.InputCount; j++) top += In(j).topRows(o.Rows);
+				break;
+			case FlatNet::OpType::Multiplier:
+				top = In(0).topRows(o.Rows);
+				for (uint32_t j = 1; j < o.InputCount; j++) top.array() *= In(j).topRows(o.Rows).array();
+				break;
+			case FlatNet::OpType::Combiner: {
+				int64_t Start = 0;
+				for (uint32_t j = 0; j < o.InputCount; j++) {
+					auto rows = Net->Ops[Net->OpInputs[o.InputStart + j]].Rows;
+					out.middleRows(Start, rows) = In(j).topRows(rows);
+					Start += rows;
+				}
+				break;
+			}
+		}
+	}
+
+	const std::vector<netData>& PopulationEvaluator::Process(const std::vector<const float*>& Candidates, const netData& Input) {
+		return Process(Candidates, std::vector<netData>{ Input });
+	}
+
+	const std::vector<netData>& PopulationEvaluator::Process(const std::vector<const float*>& Candidates, const std::vector<netData>& Inputs) {
+		auto& h = *Net->header;
+		if (Inputs.size() != Net->InputOps.size()) throw "Input count mismatch";
+		for (size_t i = 0; i < Inputs.size(); i++)
+			if (Inputs[i].rows() != Net->InputOps[i]->Rows || Inputs[i].cols() != Inputs[0].cols()) throw "Input size mismatch";
+		Resize(Candidates.size(), Inputs[0].cols());
+		for (size_t i = 0; i < Inputs.size(); i++) {
+			auto Index = Net->InputOps[i] - Net->Ops;
+			Buffers[Index].topRows(Net->Ops[Index].Rows) = Inputs[i];
+		}
+
+		for (uint32_t i = 0; i < h.OpCount; i++) {
+			auto& o = Net->Ops[i];
+			if (Shared[i]) {
+				RunOp(i, 0, nullptr);
+			} else if (Stacked[i]) {
+				const int64_t R = o.Rows;
+				StackedWeights.resize(R * Population, o.WeightCols);
+				for (int64_t p = 0; p < Population; p++)
+					StackedWeights.middleRows(p * R, R) = Eigen::Map<const netData>(Candidates[p] + DNAOffset[i], R, o.WeightCols);
+				StackedOutput.noalias() = StackedWeights * Buffers[Net->OpInputs[o.InputStart]];
+				auto& out = Buffers[i];
+				for (int64_t p = 0; p < Population; p++) {
+					auto top = out.block(0, p * Batch, R, Batch);
+					top = StackedOutput.middleRows(p * R, R);
+					Activate(top, o.Activation);
+				}
+			}
+		}
+
+		std::atomic<int64_t> Next = 0;
+		std::exception_ptr Failed;
+		std::mutex FailLock;
+		auto& Last = Net->Ops[h.OpCount - 1];
+		auto Work = [&] {
+			try {
+				for (int64_t p; (p = Next++) < Population;) {
+					for (uint32_t i = 0; i < h.OpCount; i++)
+						if (!Shared[i] && !Stacked[i]) RunOp(i, p, Candidates[p]);
+					output[p] = Buffers[h.OpCount - 1].middleCols(Shared[h.OpCount - 1] ? 0 : p * Batch, Batch).topRows(Last.Rows);
+					ApplyOutput(output[p], h.Output);
+				}
+			} catch (...) {
+				std::lock_guard<std::mutex> lock{ FailLock };
+				if (!Failed) Failed = std::current_exception();
+				Next = Population;
+			}
+		};
+		const int nThreads = int(std::min(int64_t(Threads), Population));
+#ifdef _OPENMP
+		if (nThreads > 1) {
+			#pragma omp parallel num_threads(nThreads)
+			Work();
+		} else Work();
+#else
+		std::vector<std::thread> Workers;
+		for (int t = 1; t < nThreads; t++) Workers.emplace_back(Work);
+		Work();
+		for (auto& w : Workers) w.join();
+#endif
+		if (Failed) std::rethrow_exception(Failed);
+		return output;
+	}
+
+	std::vector<float> PopulationEvaluator::Error(const std::vector<const float*>& Candidates, const netData& Input, const netData& Target) {
+		return Error(Candidates, std::vector<netData>{ Input }, Target);
+	}
+
+	std::vector<float> PopulationEvaluator::Error(const std::vector<const float*>& Candidates, const std::vector<netData>& Inputs, const netData& Target) {
+		Process(Candidates, Inputs);
+		if (Target.rows() != Net->Ops[Net->header->OpCount - 1].Rows || Target.cols() != Batch) throw "Target size mismatch";
+		std::vector<float> ret(Population);
+		for (int64_t p = 0; p < Population; p++) {
+			if (OutputType(Net->header->Output) == OutputType::MeanSquare)
+				ret[p] = 0.5f * (Target - output[p]).squaredNorm() / Batch;
+			else
+				ret[p] = -(Target.array() * output[p].array().log()).sum() / Batch;
+		}
+		return ret;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include <PVX_NeuralNetsCPU.h>
+#include <algorithm>
+
+namespace PVX::DeepNeuralNets {
+	constexpr size_t LatencySamples = 4096;
+
+	InferenceQueue::InferenceQueue(const NetContainer& Net, size_t MaxBatch, std::chrono::microseconds MaxWait) :
+		Session{ Net },
+		MaxBatch{ MaxBatch ? MaxBatch : throw "MaxBatch must be positive" },
+		MaxWait{ MaxWait },
+		nInput{ [&Net] {
+			if (Net.RNNs.size()) throw "Recurrent networks cannot be batched by InferenceQueue";
+			return Net.Inputs[0]->nInput();
+		}() },
+		Worker{ [this] { Run(); } }
+	{}
+
+	InferenceQueue::~InferenceQueue() {
+		{
+			std::lock_guard<std::mutex> lk(Lock);
+			Running = false;
+		}
+		Signal.notify_all();
+		Worker.join();
+	}
+
+	std::future<std::vector<float>> InferenceQueue::Process(const std::vector<float>& Input) {
+		if (Input.size() != nInput) throw "Input size mismatch";
+		Request r;
+		r.Input = Input;
+		r.Enqueued = std::chrono::steady_clock::now();
+		auto ret = r.Result.get_future();
+		{
+			std::lock_guard<std::mutex> lk(Lock);
+			Pending.push_back(std::move(r));
+		}
+		Signal.notify_one();
+		return ret;
+	}
+
+	static void AddSample(std::vector<float>& Samples, size_t Index, float Value) {
+		if (Samples.size() < LatencySamples) Samples.push_back(Value);
+		else Samples[Index % LatencySamples] = Value;
+	}
+
+	void InferenceQueue::Run() {
+		std::vector<Request> Batch;
+		Batch.reserve(MaxBatch);
+		std::unique_lock<std::mutex> lk(Lock);
+		while (true) {
+			Signal.wait(lk, [this] { return !Running || Pending.size(); });
+			if (Pending.empty()) return;
+			auto Deadline = Pending.front().Enqueued + MaxWait;
+			Signal.wait_until(lk, Deadline, [this] { return !Running || Pending.size() >= MaxBatch; });
+
+			size_t n = std::min(MaxBatch, Pending.size());
+			for (size_t i = 0; i < n; i++) {
+				Batch.push_back(std::move(Pending.front()));
+				Pending.pop_front();
+			}
+			lk.unlock();
+
+			auto Start = std::chrono::steady_clock::now();
+			size_t Done = 0;
+			try {
+				netData inp = netData::Ones(nInput + 1, n);
+				for (size_t i = 0; i < n; i++)
+					memcpy(inp.data() + i * (nInput + 1), Batch[i].Input.data(), nInput * sizeof(float));
+				const auto& res = Session.ProcessRaw(inp);
+				for (; Done < n; Done++) {
+					std::vector<float> out(res.rows());
+					memcpy(out.data(), res.data() + Done * res.rows(), out.size() * sizeof(float));
+					Batch[Done].Result.set_value(std::move(out));
+				}
+			} catch (...) {
+				for (; Done < n; Done++)
+					Batch[Done].Result.set_exception(std::current_exception());
+			}
+			auto End = std::chrono::steady_clock::now();
+
+			{
+				std::lock_guard<std::mutex> slk(StatsLock);
+				for (auto& r : Batch)
+					AddSample(QueueTimes, Requests++, std::chrono::duration<float, std::micro>(Start - r.Enqueued).count());
+				AddSample(ComputeTimes, Batches++, std::chrono::duration<float, std::micro>(End - Start).count());
+			}
+			Batch.clear();
+			lk.lock();
+		}
+	}
+
+	static float Percentile(std::vector<float> Samples, float p) {
+		if (!Samples.size()) return 0;
+		auto k = size_t(p * (Samples.size() - 1));
+		std::nth_element(Samples.begin(), Samples.begin() + k, Samples.end());
+		return Samples[k];
+	}
+
+	InferenceQueue::LatencyStats InferenceQueue::Stats() {
+		std::lock_guard<std::mutex> lk(StatsLock);
+		LatencyStats ret;
+		ret.QueueP50 = Percentile(QueueTimes, 0.5f);
+		ret.QueueP99 = Percentile(QueueTimes, 0.99f);
+		ret.ComputeP50 = Percentile(ComputeTimes, 0.5f);
+		ret.ComputeP99 = Percentile(ComputeTimes, 0.99f);
+		ret.Requests = Requests;
+		ret.Batches = Batches;
+		return ret;
+	}
+}
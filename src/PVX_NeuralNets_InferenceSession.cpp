@@ -0,0 +1,73 @@
+#include <PVX_NeuralNetsCPU.h>
+#include "PVX_NeuralNets_Util.inl"
+
+namespace PVX::DeepNeuralNets {
+	InferenceSession::InferenceSession(const NetContainer& Net) : Net{ Net } {
+		std::set<NeuralLayer_Base*> all;
+		Net.LastLayer->Gather(all);
+		for (auto l : all) {
+			auto& st = States[l];
+			st.output = netData::Ones(l->output.rows(), 1);
+		}
+		for (auto l : Net.Inputs)
+			Inputs.push_back(&States.at(l));
+		for (auto l : Net.RNNs)
+			Recurrent.push_back(&States.at(l));
+		ResetRNN();
+	}
+
+	void InferenceSession::FeedForward() {
+		Version++;
+		Net.LastLayer->Infer(*this);
+		const auto& last = States.at(Net.LastLayer).output;
+		switch (Net.Type) {
+			case OutputType::MeanSquare: NetContainer::OutputMeanSquare(last, output); break;
+			case OutputType::SoftMax: NetContainer::OutputSoftMax(last, output); break;
+			case OutputType::StableSoftMax: NetContainer::OutputStableSoftMax(last, output); break;
+		}
+	}
+
+	void InferenceSession::ResetRNN() {
+		for (auto r : Recurrent) {
+			auto& o = r->output;
+			o.block(0, o.cols() - 1, o.rows() - 1, 1) = netData::Zero(o.rows() - 1, 1);
+		}
+	}
+
+	const netData& InferenceSession::Process(const netData& inp) {
+		auto& o = Inputs[0]->output;
+		if (o.cols() != inp.cols())
+			o = netData::Ones(o.rows(), inp.cols());
+		outPart(o) = inp;
+		FeedForward();
+		return output;
+	}
+	const netData& InferenceSession::Process(const std::vector<netData>& inp) {
+		for (auto i = 0; i<inp.size(); i++) {
+			auto& o = Inputs[i]->output;
+			if (o.cols() != inp[i].cols())
+				o = netData::Ones(o.rows(), inp[i].cols());
+			outPart(o) = inp[i];
+		}
+		FeedForward();
+		return output;
+	}
+	const netData& InferenceSession::ProcessRaw(const netData& inp) {
+		Inputs[0]->output = inp;
+		FeedForward();
+		return output;
+	}
+	const netData& InferenceSession::ProcessRaw(const std::vector<netData>& inp) {
+		for (auto i = 0; i<inp.size(); i++)
+			Inputs[i]->output = inp[i];
+		FeedForward();
+		return output;
+	}
+	std::vector<float> InferenceSession::ProcessVec(const std::vector<float>& Inp) {
+		auto rows = Inputs[0]->output.rows() - 1;
+		const auto& tmp = Process(Eigen::Map<const netData>(Inp.data(), rows, Inp.size() / rows));
+		std::vector<float> ret(tmp.size());
+		memcpy(ret.data(), tmp.data(), ret.size() * sizeof(float));
+		return ret;
+	}
+}
@@ -1,9 +1,28 @@
 #include <PVX_NeuralNetsCPU.h>
 #include "PVX_NeuralNets_Util.inl"
+#include <algorithm>
 
 namespace PVX::DeepNeuralNets {
 
 	void NetContainer::Save(const std::wstring& Filename) {
+		Save(Filename, 0);
+	}
+	void NetContainer::Save(const std::wstring& Filename, int OptimizerState) {
+		PVX::BinSaver bin(Filename.c_str(), "NWK2");
+		Save(bin, OptimizerState);
+		bin.Save();
+	}
+	void NetContainer::Save(std::vector<unsigned char>& Output, int OptimizerState) {
+		PVX::BinSaver bin(Output, "NWK2");
+		Save(bin, OptimizerState);
+		bin.Save();
+	}
+	void NetContainer::Save(std::ostream& Output, int OptimizerState) {
+		PVX::BinSaver bin(Output, "NWK2");
+		Save(bin, OptimizerState);
+		bin.Save();
+	}
+	void NetContainer::Save(PVX::BinSaver& bin, int OptimizerState) {
 		std::map<NeuralLayer_Base*, size_t> g;
 		std::vector<NeuralLayer_Base*> all;
 		{
@@ -16,29 +35,48 @@ namespace PVX::DeepNeuralNets {
 				g[l] = i++;
 			}
 		}
-		PVX::BinSaver bin(Filename.c_str(), "NWK2"); {
-			bin.Write("TYPE", int(Type));
-			bin.Write("ERRO", error);
-			bin.Write("LAST", g[LastLayer]);
-			bin.Begin("LYRS"); for (auto l: all) {
-				l->Save(bin, g);
+		uint64_t WeightBytes = 0;
+		for (auto l : all)
+			if (auto dense = dynamic_cast<NeuronLayer*>(l)) WeightBytes += dense->WeightsView().size() * sizeof(float);
+		int Large = WeightBytes * (OptimizerState ? 3 : 1) >= (~0u >> 1);
+		if (Large) bin.Wide();
+		bin.Indexed();
+		bin.Write("TYPE", int(Type));
+		bin.Write("ERRO", error);
+		bin.Write("LAST", g[LastLayer]);
+		bin.Begin("LYRS", Large); for (auto l: all) {
+			l->Save(bin, g);
+		} bin.End();
+		if (OptimizerState) {
+			bin.Begin("OPTM", Large); for (auto l : all) {
+				auto dense = dynamic_cast<NeuronLayer*>(l);
+				if (!dense || dense->WeightView) continue;
+				bin.Begin("LOPT"); {
+					bin.Write("INDX", int(g[l]));
+					bin.Write("DWGT", dense->DeltaWeights.data(), dense->DeltaWeights.size());
+					bin.Write("RMSW", dense->RMSprop.data(), dense->RMSprop.size());
+				} bin.End();
 			} bin.End();
 		}
 	}
 	void NetContainer::SaveCheckpoint() {
+		if (ReadOnly) throw "Mapped layers are read-only";
 		Checkpoint.GetData(CheckpointDNA);
 		CheckpointError = error;
 	}
 	float NetContainer::LoadCheckpoint() {
+		if (ReadOnly) throw "Mapped layers are read-only";
 		error = CheckpointError;
 		Checkpoint.SetData(CheckpointDNA.data());
 		return error;
 	}
 	float NetContainer::SaveCheckpoint(std::vector<float>& data) {
+		if (ReadOnly) throw "Mapped layers are read-only";
 		Checkpoint.GetData(data);
 		return error;
 	}
 	void NetContainer::LoadCheckpoint(const std::vector<float>& data, float Error) {
+		if (ReadOnly) throw "Mapped layers are read-only";
 		Checkpoint.SetData(data.data());
 		error = Error;
 	}
@@ -104,62 +142,148 @@ namespace PVX::DeepNeuralNets {
 			return a->Id<b->Id;
 		});
 
-		Checkpoint = GetDNA();
+		for (auto d : DenseLayers)
+			if (d->WeightView) ReadOnly = 1;
+		if (!ReadOnly) Checkpoint = GetDNA();
 	}
 	NetContainer::NetContainer(NeuralLayer_Base* Last, OutputType Type) :LastLayer{ Last }, Type{ Type } {
 		Init();
 	}
-	NetContainer::NetContainer(const std::wstring& Filename) {
-		{
-			size_t LastLayerIndex;
-			int tp;
-			PVX::BinLoader bin(Filename.c_str(), "NWK2");
-			bin.Process("LYRS", [&](PVX::BinLoader& bin2) {
-				bin2.Process("ACTV", [&](PVX::BinLoader& bin3) {
-					this->OwnedLayers.push_back(ActivationLayer::Load2(bin3));
-				});
-				bin2.Process("INPT", [&](PVX::BinLoader& bin3) {
-					this->OwnedLayers.push_back(new InputLayer(bin3));
-				});
-				bin2.Process("DENS", [&](PVX::BinLoader& bin3) {
-					this->OwnedLayers.push_back(NeuronLayer::Load2(bin3));
-				});
-				bin2.Process("ADDR", [&](PVX::BinLoader& bin3) {
-					this->OwnedLayers.push_back(NeuronAdder::Load2(bin3));
-				});
-				bin2.Process("MULP", [&](PVX::BinLoader& bin3) {
-					this->OwnedLayers.push_back(NeuronMultiplier::Load2(bin3));
+	NetContainer::NetContainer(const std::wstring& Filename) : NetContainer(Filename, 0) {}
+	NeuralLayer_Base* NetContainer::LoadLayer(unsigned int Tag, PVX::BinLoader& bin, const char* Mapped) {
+		switch (Tag) {
+			case TAG('A', 'C', 'T', 'V'): return ActivationLayer::Load2(bin);
+			case TAG('I', 'N', 'P', 'T'): return new InputLayer(bin);
+			case TAG('D', 'E', 'N', 'S'): return NeuronLayer::Load2(bin, Mapped);
+			case TAG('A', 'D', 'D', 'R'): return NeuronAdder::Load2(bin);
+			case TAG('M', 'U', 'L', 'P'): return NeuronMultiplier::Load2(bin);
+			case TAG('C', 'M', 'B', 'N'): return NeuronCombiner::Load2(bin);
+			case TAG('R', 'N', 'N', 'e'): return RecurrentLayer::Load2(bin);
+			case TAG('R', 'N', 'N', 's'): return RecurrentInput::Load2(bin);
+		}
+		return nullptr;
+	}
+	NetContainer::NetContainer(const std::wstring& Filename, int MapWeights) {
+		const char* Mapped = nullptr;
+		if (MapWeights) {
+			Mapping = std::make_shared<PVX::BinMapping>(Filename.c_str());
+			Mapped = Mapping->data();
+		}
+		PVX::BinLoader bin(Filename.c_str(), "NWK2");
+		Load(bin, [&] { return std::make_unique<PVX::BinLoader>(Filename.c_str(), "NWK2"); }, Mapped);
+	}
+	NetContainer::NetContainer(const unsigned char* Data, size_t Size, int MapWeights) {
+		PVX::BinLoader bin(Data, Size, "NWK2");
+		Load(bin, [&] { return std::make_unique<PVX::BinLoader>(Data, Size, "NWK2"); }, MapWeights ? (const char*)Data : nullptr);
+	}
+	NetContainer::NetContainer(std::istream& Stream) {
+		PVX::BinLoader bin(Stream, "NWK2");
+		Load(bin, nullptr, nullptr);
+	}
+	void NetContainer::Load(PVX::BinLoader& bin, std::function<std::unique_ptr<PVX::BinLoader>()> Reopen, const char* Mapped) {
+		try {
+			{
+				size_t LastLayerIndex = 0;
+				int tp = 0;
+				auto Index = bin.ReadIndex();
+				std::vector<PVX::BinIndexEntry> Layers;
+				for (auto i = 0; i < Index.size(); i++) {
+					if (Index[i].Parent < Index.size() && Index[Index[i].Parent].iName == TAG('L', 'Y', 'R', 'S') && Index[Index[i].Parent].Parent == 0)
+						Layers.push_back(Index[i]);
+				}
+				if (Reopen && Layers.size() > 1) {
+					OwnedLayers.resize(Layers.size());
+					std::atomic<size_t> Next{ 0 };
+					std::exception_ptr Error;
+					std::mutex ErrorLock;
+					std::vector<std::thread> Workers(std::min(Layers.size(), size_t(std::max(1u, std::thread::hardware_concurrency()))));
+					for (auto& w : Workers) w = std::thread([&] {
+						try {
+							auto bin2 = Reopen();
+							for (size_t i; (i = Next++) < Layers.size();)
+								bin2->Seek(Layers[i], [&](PVX::BinLoader& bin3) {
+									OwnedLayers[i] = LoadLayer(Layers[i].iName, bin3, Mapped);
+								});
+							bin2->Skip();
+						} catch (...) {
+							std::lock_guard<std::mutex> lk(ErrorLock);
+							if (!Error) Error = std::current_exception();
+							Next = Layers.size();
+						}
+					});
+					for (auto& w : Workers) w.join();
+					if (Error) std::rethrow_exception(Error);
+					OwnedLayers.erase(std::remove(OwnedLayers.begin(), OwnedLayers.end(), nullptr), OwnedLayers.end());
+					bin.Process("LYRS", [](PVX::BinLoader& bin2) { bin2.Skip(); });
+				} else {
+					bin.Process("LYRS", [&](PVX::BinLoader& bin2) {
+						bin2.ProcessAny([&](PVX::BinLoader& bin3, const char* Name) {
+							auto l = LoadLayer(*(unsigned int*)Name, bin3, Mapped);
+							if (l) this->OwnedLayers.push_back(l);
+						});
+					});
+				}
+
+				std::vector<std::tuple<int, std::vector<float>, std::vector<float>>> Optimizer;
+				bin.Process("OPTM", [&](PVX::BinLoader& bin2) {
+					bin2.Process("LOPT", [&](PVX::BinLoader& bin3) {
+						int Index = 0;
+						std::vector<float> Delta, RMS;
+						bin3.Read("INDX", Index);
+						bin3.Read("DWGT", Delta);
+						bin3.Read("RMSW", RMS);
+						bin3.Execute();
+						Optimizer.push_back({ Index, std::move(Delta), std::move(RMS) });
+					});
 				});
-				bin2.Process("CMBN", [&](PVX::BinLoader& bin3) {
-					this->OwnedLayers.push_back(NeuronCombiner::Load2(bin3));
+				bin.Process("LAST", [&](PVX::BinLoader& bin2) { 
+					LastLayerIndex = bin2.read<size_t>(); 
 				});
-				bin2.Process("RNNe", [&](PVX::BinLoader& bin3) {
-					this->OwnedLayers.push_back(RecurrentLayer::Load2(bin3));
+				bin.Process("TYPE", [&](PVX::BinLoader& bin2) { 
+					tp = bin2.read<int>();
 				});
-				bin2.Process("RNNs", [&](PVX::BinLoader& bin3) {
-					this->OwnedLayers.push_back(RecurrentInput::Load2(bin3));
+				bin.Process("ERRO", [&](PVX::BinLoader& bin2) { 
+					error = bin2.read<float>(); 
 				});
-			});
-
-			bin.Process("LAST", [&](PVX::BinLoader& bin2) { 
-				LastLayerIndex = bin2.read<size_t>(); 
-			});
-			bin.Process("TYPE", [&](PVX::BinLoader& bin2) { 
-				tp = bin2.read<int>();
-			});
-			bin.Process("ERRO", [&](PVX::BinLoader& bin2) { 
-				error = bin2.read<float>(); 
-			});
-			bin.Execute();
-			Type = OutputType(tp);
-			LastLayer = OwnedLayers[LastLayerIndex-1ll];
+				bin.Execute();
+				if (!LastLayerIndex || LastLayerIndex > OwnedLayers.size())
+					throw "Invalid network file";
+				Type = OutputType(tp);
+				LastLayer = OwnedLayers[LastLayerIndex-1ll];
+				for (auto& [Index, Delta, RMS] : Optimizer) {
+					auto dense = (Index > 0 && Index <= OwnedLayers.size()) ? dynamic_cast<NeuronLayer*>(OwnedLayers[Index - 1ll]) : nullptr;
+					if (!dense || dense->WeightView) continue;
+					if (Delta.size() == dense->DeltaWeights.size()) memcpy(dense->DeltaWeights.data(), Delta.data(), Delta.size() * sizeof(float));
+					if (RMS.size() == dense->RMSprop.size()) memcpy(dense->RMSprop.data(), RMS.data(), RMS.size() * sizeof(float));
+				}
+			}
+			for (auto l : OwnedLayers) {
+				l->FixInputs(OwnedLayers);
+				auto rnns = dynamic_cast<RecurrentLayer*>(l);
+				if (rnns) 
+					rnns->RNN_Input = (RecurrentInput*)OwnedLayers[(*(int*)&rnns->RNN_Input)-1ll];
+			}
+		} catch (...) {
+			for (auto l : OwnedLayers) delete l;
+			OwnedLayers.clear();
+			throw;
 		}
+		Init();
+	}
+	NetContainer::NetContainer(const NetContainer& net) : Mapping{ net.Mapping }, Type{ net.Type }, error{ net.error } {
+		std::set<NeuralLayer_Base*> layers;
+		net.LastLayer->Gather(layers);
+		std::map<NeuralLayer_Base*, size_t> IndexOf;
+		size_t i = 1;
+		for (auto l : layers) IndexOf[l] = i++;
+		for (auto l : layers) OwnedLayers.push_back(l->newCopy(IndexOf));
 		for (auto l : OwnedLayers) {
 			l->FixInputs(OwnedLayers);
 			auto rnns = dynamic_cast<RecurrentLayer*>(l);
-			if (rnns) 
+			if (rnns)
 				rnns->RNN_Input = (RecurrentInput*)OwnedLayers[(*(int*)&rnns->RNN_Input)-1ll];
 		}
+		LastLayer = OwnedLayers[IndexOf.at(net.LastLayer)-1ll];
 		Init();
 	}
 	NetContainer::~NetContainer() {
@@ -328,35 +452,28 @@ namespace PVX::DeepNeuralNets {
 		return -(Data.array()* Eigen::log(output.array())).sum() / output.cols();
 	}
 
-	void NetContainer::FeedForwardMeanSquare() {
-		LastLayer->FeedForward(++Version);
-		auto tmp = LastLayer->Output();
-		output = outPart(tmp);
+	void NetContainer::OutputMeanSquare(const netData& Last, netData& Output) {
+		Output = Last.block(0, 0, Last.rows() - 1, Last.cols());
 	}
-	void NetContainer::FeedForwardSoftMax() {
-		LastLayer->FeedForward(++Version);
-		auto tmp2 = LastLayer->Output();
+	void NetContainer::OutputSoftMax(const netData& Last, netData& Output) {
+		CorrectMat(Last);
 
-		CorrectMat(tmp2);
-
-		netData tmp = Eigen::exp(outPart(tmp2).array());
+		netData tmp = Eigen::exp(Last.block(0, 0, Last.rows() - 1, Last.cols()).array());
 		CorrectMat(tmp);
 
 		netData a = 1.0f / (netData::Ones(1, tmp.rows()) * tmp).array();
 		CorrectMat(a);
 		netData div = Eigen::Map<Eigen::RowVectorXf>(a.data(), a.size()).asDiagonal();
 		CorrectMat(div);
-		output = (tmp * div);
-		CorrectMat(output);
+		Output = (tmp * div);
+		CorrectMat(Output);
 	}
-	void NetContainer::FeedForwardStableSoftMax() {
-		LastLayer->FeedForward(++Version);
-		netData tmp = LastLayer->Output();
-		output = outPart(tmp);
-		CorrectMat(output);
+	void NetContainer::OutputStableSoftMax(const netData& Last, netData& Output) {
+		Output = Last.block(0, 0, Last.rows() - 1, Last.cols());
+		CorrectMat(Output);
 
-		for (auto i = 0; i < output.cols(); i++) {
-			auto r = output.col(i);
+		for (auto i = 0; i < Output.cols(); i++) {
+			auto r = Output.col(i);
 			r -= netData::Constant(r.rows(), 1, r.maxCoeff());
 			r = Eigen::exp(r.array());
 			r *= 1.0f / r.sum();
@@ -364,6 +481,19 @@ namespace PVX::DeepNeuralNets {
 			CorrectMat(r);
 		}
 	}
+
+	void NetContainer::FeedForwardMeanSquare() {
+		LastLayer->FeedForward(++Version);
+		OutputMeanSquare(LastLayer->output, output);
+	}
+	void NetContainer::FeedForwardSoftMax() {
+		LastLayer->FeedForward(++Version);
+		OutputSoftMax(LastLayer->output, output);
+	}
+	void NetContainer::FeedForwardStableSoftMax() {
+		LastLayer->FeedForward(++Version);
+		OutputStableSoftMax(LastLayer->output, output);
+	}
 	
 	netData Reorder2(const netData& data, const size_t* Order, size_t count) {
 		netData ret(data.rows(), count);
@@ -506,4 +636,49 @@ namespace PVX::DeepNeuralNets {
 		memcpy(ret.data(), tmp.data(), ret.size() * sizeof(float));
 		return ret;
 	}
-};
\ No newline at end of file
+
+	void NetContainer::CopyWeightsFrom(const NetContainer& from) {
+		auto src = from.DenseLayers.cbegin();
+		auto dst = DenseLayers.begin();
+		for (; src<from.DenseLayers.cend(); ++src, ++dst) {
+			(*dst)->GetWeights() = (*src)->WeightsView();
+		}
+	}
+	void NetContainer::CopyStateFrom(const NetContainer& from) {
+		auto src = from.DenseLayers.cbegin();
+		auto dst = DenseLayers.begin();
+		for (; src<from.DenseLayers.cend(); ++src, ++dst) {
+			if ((*src)->WeightView) throw "Mapped layers have no optimizer state";
+			(*dst)->GetWeights() = (*src)->WeightsView();
+			(*dst)->DeltaWeights = (*src)->DeltaWeights;
+			(*dst)->RMSprop = (*src)->RMSprop;
+		}
+		error = from.error;
+	}
+
+	std::vector<NetContainer::LayerProfile> NetContainer::Profile() const {
+		std::set<NeuralLayer_Base*> all;
+		LastLayer->Gather(all);
+		std::vector<LayerProfile> ret;
+		double Total = 0;
+		for (auto l : all) {
+			for (int s = 0; s < 3; s++) {
+				const auto& p = l->Profile[s];
+				if (!p.Calls) continue;
+				Total += p.Seconds;
+				ret.push_back({ l->Name(), l->Id, ProfileStage(s), p.Calls, p.Columns, p.Seconds, p.Flops, p.Bytes,
+					p.Seconds > 0 ? p.Flops / p.Seconds * 1e-9 : 0, 0 });
+			}
+		}
+		for (auto& r : ret)
+			r.Share = Total > 0 ? r.Seconds / Total : 0;
+		std::sort(ret.begin(), ret.end(), [](const LayerProfile& a, const LayerProfile& b) { return a.Seconds > b.Seconds; });
+		return ret;
+	}
+	void NetContainer::ResetProfile() {
+		std::set<NeuralLayer_Base*> all;
+		LastLayer->Gather(all);
+		for (auto l : all)
+			for (auto& p : l->Profile) p = {};
+	}
+};
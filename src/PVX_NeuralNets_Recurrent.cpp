@@ -4,15 +4,15 @@
 
 namespace PVX::DeepNeuralNets {
 	NeuralLayer_Base* RecurrentLayer::newCopy(const std::map<NeuralLayer_Base*, size_t>& IndexOf) {
-		auto ret = new RecurrentLayer(
-			reinterpret_cast<NeuralLayer_Base*>(IndexOf.at(PreviousLayer)), 
-			reinterpret_cast<RecurrentInput*>(IndexOf.at(RNN_Input))
-		);
+		auto ret = new RecurrentLayer(output.rows());
+		ret->PreviousLayer = reinterpret_cast<NeuralLayer_Base*>(IndexOf.at(PreviousLayer));
+		ret->RNN_Input = reinterpret_cast<RecurrentInput*>(IndexOf.at(RNN_Input));
 		ret->Id = Id;
 		return ret;
 	}
 	void RecurrentLayer::FeedForward(int64_t Version) {
 		if (Version > FeedVersion) {
+			ProfileScope Scope(this, ProfileStage::FeedForward);
 			RNN_Input->FeedForward(Version);
 			int64_t bSize = RNN_Input->BatchSize();
 			if (output.cols() != bSize) {
@@ -27,6 +27,36 @@ namespace PVX::DeepNeuralNets {
 			output.row(output.rows()-1) = netData::Ones(1, bSize);
 		}
 	}
+	void RecurrentLayer::Infer(InferenceSession& s) const {
+		auto& st = s.State(this);
+		if (s.CurrentVersion() > st.FeedVersion) {
+			st.FeedVersion = s.CurrentVersion();
+			RNN_Input->Infer(s);
+			auto& rnn = s.State(RNN_Input).output;
+			const auto& prev = s.State(PreviousLayer);
+			int64_t bSize = rnn.cols();
+			if (s.Stepping()) {
+				rnn.block(0, 0, RNN_Input->RecurrentNeuronCount, bSize) = st.Hidden;
+				PreviousLayer->Infer(s);
+				st.output = prev.output;
+				st.Hidden = st.output.block(0, 0, st.output.rows() - 1, bSize);
+				return;
+			}
+			if (st.output.cols() != bSize) {
+				st.output = netData::Zero(st.output.rows(), bSize);
+				st.output(st.output.rows()-1, 0) = 1.0f;
+			}
+			for (int64_t i = 0; i<bSize; i++) {
+				rnn.block(0, i, RNN_Input->RecurrentNeuronCount, 1) = st.output.block(0, (i + bSize - 1) % bSize, st.output.rows() - 1, 1);
+				PreviousLayer->Infer(s, i);
+				st.output.col(i) = prev.output.col(i);
+			}
+			st.output.row(st.output.rows()-1) = netData::Ones(1, bSize);
+		}
+	}
+	void RecurrentLayer::Infer(InferenceSession& s, int64_t Index) const {
+		throw "Unimplementable?";
+	}
 	void RecurrentLayer::Reset() {
 		output.block(0, output.cols()-1, output.rows()-1, 1) = netData::Zero(output.rows()-1, 1);
 	}
@@ -75,6 +105,7 @@ namespace PVX::DeepNeuralNets {
 		return PreviousLayer->DNA(Weights);
 	}
 	void RecurrentLayer::BackPropagate(const netData& Gradient) {
+		ProfileScope Scope(this, ProfileStage::BackPropagate, Gradient.cols());
 		RNN_Input->ZeroGradient(Gradient.cols());
 		netData grad = Gradient;
 		int64_t i = Gradient.cols() - 1;
@@ -93,6 +124,7 @@ namespace PVX::DeepNeuralNets {
 		return PreviousLayer->nInput();
 	}
 	void RecurrentLayer::UpdateWeights() {
+		ProfileScope Scope(this, ProfileStage::UpdateWeights);
 		PreviousLayer->UpdateWeights();
 	}
 
@@ -119,10 +151,8 @@ namespace PVX::DeepNeuralNets {
 		bin.End();
 	}
 	NeuralLayer_Base* RecurrentInput::newCopy(const std::map<NeuralLayer_Base*, size_t>& IndexOf) {
-		auto ret = new RecurrentInput(
-			reinterpret_cast<NeuralLayer_Base*>(IndexOf.at(PreviousLayer)),
-			RecurrentNeuronCount
-		);
+		auto ret = new RecurrentInput(RecurrentNeuronCount, PreviousLayer->nOutput());
+		ret->PreviousLayer = reinterpret_cast<NeuralLayer_Base*>(IndexOf.at(PreviousLayer));
 		ret->Id = Id;
 		return ret;
 	}
@@ -153,6 +183,7 @@ namespace PVX::DeepNeuralNets {
 	}
 	void RecurrentInput::FeedForward(int64_t ver) {
 		if (ver>FeedVersion) {
+			ProfileScope Scope(this, ProfileStage::FeedForward);
 			FeedVersion = ver;
 			PreviousLayer->FeedForward(ver);
 			const auto& prev = PreviousLayer->Output();
@@ -169,10 +200,27 @@ namespace PVX::DeepNeuralNets {
 
 
 
+	void RecurrentInput::Infer(InferenceSession& s) const {
+		auto& st = s.State(this);
+		if (s.CurrentVersion() > st.FeedVersion) {
+			st.FeedVersion = s.CurrentVersion();
+			PreviousLayer->Infer(s);
+			const auto& prev = s.State(PreviousLayer).output;
+			if (st.output.cols() != prev.cols()) {
+				st.output = netData::Zero(prev.rows() + RecurrentNeuronCount, prev.cols());
+			}
+			st.output.block(RecurrentNeuronCount, 0, prev.rows(), prev.cols()) = prev;
+		}
+	}
+	void RecurrentInput::Infer(InferenceSession& s, int64_t Index) const {
+		Infer(s);
+	}
+
 	size_t RecurrentInput::DNA(std::map<void*, WeightData>& Weights) {
 		return PreviousLayer->DNA(Weights);
 	}
 	void RecurrentInput::BackPropagate() {
+		ProfileScope Scope(this, ProfileStage::BackPropagate, gradient.cols());
 		PreviousLayer->BackPropagate(gradient.block(RecurrentNeuronCount, 0, gradient.rows()- RecurrentNeuronCount, gradient.cols()));
 	}
 	void RecurrentInput::ZeroGradient(int64_t cols) {
@@ -187,12 +235,14 @@ namespace PVX::DeepNeuralNets {
 		//PreviousLayer->BackPropagate(grad.block(RecurrentNeuronCount, 0, grad.rows()- RecurrentNeuronCount, grad.cols()));
 	}
 	void RecurrentInput::BackPropagate(const netData& grad, int64_t Index) {
+		ProfileScope Scope(this, ProfileStage::BackPropagate, 1);
 		gradient.col(Index) += grad;
 	}
 	size_t RecurrentInput::nInput() const {
 		return output.rows() - 1;
 	}
 	void RecurrentInput::UpdateWeights() {
+		ProfileScope Scope(this, ProfileStage::UpdateWeights);
 		PreviousLayer->UpdateWeights();
 	}
 
@@ -0,0 +1,87 @@
+#include <PVX_NeuralNetsCPU.h>
+#include "PVX_NeuralNets_Util.inl"
+
+namespace PVX::DeepNeuralNets {
+	RecurrentStream::RecurrentStream(const NetContainer& Net) : InferenceSession(Net) {
+		StepMode = 1;
+		for (auto r : Recurrent) {
+			Offsets.push_back(StateSize);
+			StateSize += r->output.rows() - 1;
+		}
+		Pool = netData::Zero(StateSize, 0);
+	}
+
+	size_t RecurrentStream::Open() {
+		size_t ret;
+		if (FreeHandles.size()) {
+			ret = FreeHandles.back();
+			FreeHandles.pop_back();
+		} else {
+			ret = Pool.cols();
+			Pool.conservativeResize(Eigen::NoChange, std::max(Eigen::Index(16), Pool.cols() * 2));
+			for (auto i = Pool.cols() - 1; i > Eigen::Index(ret); i--)
+				FreeHandles.push_back(i);
+			Opened.resize(Pool.cols());
+		}
+		Opened[ret] = 1;
+		Reset(ret);
+		return ret;
+	}
+	void RecurrentStream::Check(size_t Handle) const {
+		if (Handle >= Opened.size() || !Opened[Handle]) throw "Invalid stream handle";
+	}
+	void RecurrentStream::Close(size_t Handle) {
+		Check(Handle);
+		Opened[Handle] = 0;
+		FreeHandles.push_back(Handle);
+	}
+	void RecurrentStream::Reset(size_t Handle) {
+		Check(Handle);
+		Pool.col(Handle).setZero();
+	}
+	std::vector<float> RecurrentStream::Snapshot(size_t Handle) const {
+		Check(Handle);
+		std::vector<float> ret(StateSize);
+		memcpy(ret.data(), Pool.data() + Handle * StateSize, StateSize * sizeof(float));
+		return ret;
+	}
+	void RecurrentStream::Restore(size_t Handle, const std::vector<float>& State) {
+		Check(Handle);
+		if (State.size() != StateSize) throw "State size mismatch";
+		memcpy(Pool.data() + Handle * StateSize, State.data(), StateSize * sizeof(float));
+	}
+
+	void RecurrentStream::Gather(const std::vector<size_t>& Handles) {
+		for (auto h : Handles) Check(h);
+		for (auto r = 0; r < Recurrent.size(); r++) {
+			auto& h = Recurrent[r]->Hidden;
+			auto rows = Recurrent[r]->output.rows() - 1;
+			if (h.rows() != rows || h.cols() != Handles.size())
+				h.resize(rows, Handles.size());
+			for (auto i = 0; i < Handles.size(); i++)
+				h.col(i) = Pool.block(Offsets[r], Handles[i], rows, 1);
+		}
+	}
+	void RecurrentStream::Scatter(const std::vector<size_t>& Handles) {
+		for (auto r = 0; r < Recurrent.size(); r++) {
+			const auto& h = Recurrent[r]->Hidden;
+			for (auto i = 0; i < Handles.size(); i++)
+				Pool.block(Offsets[r], Handles[i], h.rows(), 1) = h.col(i);
+		}
+	}
+
+	const netData& RecurrentStream::Step(const std::vector<size_t>& Handles, const netData& inp) {
+		if (size_t(inp.cols()) != Handles.size()) throw "Input columns do not match handle count";
+		Gather(Handles);
+		Process(inp);
+		Scatter(Handles);
+		return output;
+	}
+	const netData& RecurrentStream::StepRaw(const std::vector<size_t>& Handles, const netData& inp) {
+		if (size_t(inp.cols()) != Handles.size()) throw "Input columns do not match handle count";
+		Gather(Handles);
+		ProcessRaw(inp);
+		Scatter(Handles);
+		return output;
+	}
+}
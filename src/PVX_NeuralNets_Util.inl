@@ -1,5 +1,5 @@
 #define EIGEN_MPL2_ONLY
-#include <Eigen/dense>
+#include <Eigen/Dense>
 using netData = Eigen::MatrixXf;
 
 inline Eigen::Block<netData, -1, -1, false> outPart(netData & m) {
@@ -29,4 +29,41 @@ inline size_t _CorrectMat(const netData& m) {
 		}
 	}
 	return 0;
-}
\ No newline at end of file
+}
+
+namespace PVX::DeepNeuralNets {
+	class ProfileScope {
+		NeuralLayer_Base* Layer = nullptr;
+		ProfileStage Stage;
+		int64_t Columns;
+		ProfileScope* Parent;
+		double Children = 0;
+		std::chrono::steady_clock::time_point Start;
+		inline static thread_local ProfileScope* Current = nullptr;
+	public:
+		ProfileScope(NeuralLayer_Base* Layer, ProfileStage Stage, int64_t Columns = -1) {
+			if (!NeuralLayer_Base::Profiling) return;
+			this->Layer = Layer;
+			this->Stage = Stage;
+			this->Columns = Columns;
+			Parent = Current;
+			Current = this;
+			Start = std::chrono::steady_clock::now();
+		}
+		~ProfileScope() {
+			if (!Layer) return;
+			double Total = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+			Current = Parent;
+			if (Parent) Parent->Children += Total;
+			size_t Cols = Columns < 0 ? Layer->output.cols() : Columns;
+			double Flops = 0, Bytes = 0;
+			Layer->Cost(Stage, Cols, Flops, Bytes);
+			auto& p = Layer->Profile[int(Stage)];
+			p.Calls++;
+			p.Columns += Cols;
+			p.Seconds += Total - Children;
+			p.Flops += Flops;
+			p.Bytes += Bytes;
+		}
+	};
+}
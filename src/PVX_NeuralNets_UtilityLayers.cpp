@@ -79,6 +79,7 @@ namespace PVX {
 
 		void NeuronAdder::FeedForward(int64_t Version) {
 			if (Version > FeedVersion) {
+				ProfileScope Scope(this, ProfileStage::FeedForward);
 				InputLayers[0]->FeedForward(Version);
 				output = InputLayers[0]->Output();
 				for (auto i = 1; i < InputLayers.size(); i++) {
@@ -97,6 +98,7 @@ namespace PVX {
 			}
 			if (Index > FeedIndexVersion) {
 				FeedIndexVersion = Index;
+				ProfileScope Scope(this, ProfileStage::FeedForward, 1);
 				InputLayers[0]->FeedForward(Index, Version);
 				const auto& pro = InputLayers[0]->Output();
 				if (pro.cols() != output.cols()) {
@@ -111,15 +113,59 @@ namespace PVX {
 			}
 		}
 
+		void NeuronAdder::Infer(InferenceSession& s) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				InputLayers[0]->Infer(s);
+				st.output = s.State(InputLayers[0]).output;
+				for (auto i = 1; i < InputLayers.size(); i++) {
+					InputLayers[i]->Infer(s);
+					st.output += s.State(InputLayers[i]).output;
+				}
+				st.output.row(st.output.rows() - 1) = netData::Ones(1, st.output.cols());
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = st.output.cols();
+			}
+		}
+		void NeuronAdder::Infer(InferenceSession& s, int64_t Index) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = -1;
+			}
+			if (Index > st.FeedIndexVersion) {
+				st.FeedIndexVersion = Index;
+				InputLayers[0]->Infer(s, Index);
+				const auto& pro = s.State(InputLayers[0]).output;
+				if (pro.cols() != st.output.cols()) {
+					st.output = netData::Zero(st.output.rows(), pro.cols());
+				}
+				st.output.col(Index) = pro.col(Index);
+				for (auto i = 1; i < InputLayers.size(); i++) {
+					InputLayers[i]->Infer(s, Index);
+					st.output.col(Index) += s.State(InputLayers[i]).output.col(Index);
+				}
+				st.output(st.output.rows()-1, Index) = 1.0f;
+			}
+		}
+
 		void NeuronAdder::BackPropagate(const netData & Gradient) {
+			ProfileScope Scope(this, ProfileStage::BackPropagate, Gradient.cols());
 			for (auto i : InputLayers) i->BackPropagate(Gradient);
 		}
 		void NeuronAdder::BackPropagate(const netData& Gradient, int64_t Index) {
+			ProfileScope Scope(this, ProfileStage::BackPropagate, 1);
 			for (auto i : InputLayers) i->BackPropagate(Gradient, Index);
 		}
 		void NeuronAdder::UpdateWeights() {
+			ProfileScope Scope(this, ProfileStage::UpdateWeights);
 			for (auto i: InputLayers) i->UpdateWeights();
 		}
+		void NeuronAdder::Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const {
+			double Size = double(output.rows()) * Columns, n = double(InputLayers.size());
+			Flops = Stage == ProfileStage::FeedForward ? (n - 1.0) * Size : 0;
+			Bytes = Stage == ProfileStage::FeedForward ? 4.0 * (n + 1.0) * Size : 0;
+		}
 		size_t NeuronAdder::nInput() const {
 			return output.rows() - 1;
 		}
@@ -192,6 +238,7 @@ namespace PVX {
 
 		void NeuronMultiplier::FeedForward(int64_t Version) {
 			if (Version > FeedVersion) {
+				ProfileScope Scope(this, ProfileStage::FeedForward);
 				InputLayers[0]->FeedForward(Version);
 				output = InputLayers[0]->Output();
 				for (auto i = 1; i < InputLayers.size(); i++) {
@@ -209,6 +256,7 @@ namespace PVX {
 			}
 			if (Index > FeedIndexVersion) {
 				FeedIndexVersion = Index;
+				ProfileScope Scope(this, ProfileStage::FeedForward, 1);
 				InputLayers[0]->FeedForward(Index, Version);
 				const auto& pro = InputLayers[0]->Output();
 				if (pro.cols() != output.cols()) {
@@ -223,7 +271,42 @@ namespace PVX {
 			}
 		}
 
+		void NeuronMultiplier::Infer(InferenceSession& s) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				InputLayers[0]->Infer(s);
+				st.output = s.State(InputLayers[0]).output;
+				for (auto i = 1; i < InputLayers.size(); i++) {
+					InputLayers[i]->Infer(s);
+					st.output.array() *= s.State(InputLayers[i]).output.array();
+				}
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = st.output.cols();
+			}
+		}
+		void NeuronMultiplier::Infer(InferenceSession& s, int64_t Index) const {
+			auto& st = s.State(this);
+			if (s.CurrentVersion() > st.FeedVersion) {
+				st.FeedVersion = s.CurrentVersion();
+				st.FeedIndexVersion = -1;
+			}
+			if (Index > st.FeedIndexVersion) {
+				st.FeedIndexVersion = Index;
+				InputLayers[0]->Infer(s, Index);
+				const auto& pro = s.State(InputLayers[0]).output;
+				if (pro.cols() != st.output.cols()) {
+					st.output = netData::Zero(st.output.rows(), pro.cols());
+				}
+				st.output.col(Index) = pro.col(Index);
+				for (auto i = 1; i < InputLayers.size(); i++) {
+					InputLayers[i]->Infer(s, Index);
+					st.output.col(Index).array() *= s.State(InputLayers[i]).output.col(Index).array();
+				}
+			}
+		}
+
 		void NeuronMultiplier::BackPropagate(const netData & Gradient) {
+			ProfileScope Scope(this, ProfileStage::BackPropagate, Gradient.cols());
 			{
 				auto tmp = InputLayers[1]->RealOutput().array();
 				for (auto i = 2; i < InputLayers.size(); i++) {
@@ -240,6 +323,7 @@ namespace PVX {
 			}
 		}
 		void NeuronMultiplier::BackPropagate(const netData& Gradient, int64_t Index) {
+			ProfileScope Scope(this, ProfileStage::BackPropagate, 1);
 			{
 				auto tmp = InputLayers[1]->RealOutput(Index).array();
 				for (auto i = 2; i < InputLayers.size(); i++) {
@@ -257,8 +341,17 @@ namespace PVX {
 		}
 
 		void NeuronMultiplier::UpdateWeights() {
+			ProfileScope Scope(this, ProfileStage::UpdateWeights);
 			for (auto i: InputLayers) i->UpdateWeights();
 		}
+		void NeuronMultiplier::Cost(ProfileStage Stage, size_t Columns, double& Flops, double& Bytes) const {
+			double Size = double(output.rows()) * Columns, n = double(InputLayers.size());
+			switch (Stage) {
+				case ProfileStage::FeedForward: Flops = (n - 1.0) * Size; Bytes = 4.0 * (n + 1.0) * Size; break;
+				case ProfileStage::BackPropagate: Flops = n * n * Size; Bytes = 4.0 * n * (n + 1.0) * Size; break;
+				default: Flops = Bytes = 0;
+			}
+		}
 		size_t NeuronMultiplier::nInput() const {
 			return output.cols();
 		}
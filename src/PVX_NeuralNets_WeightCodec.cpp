@@ -0,0 +1,201 @@
+#include <PVX_NeuralNetsCPU.h>
+
+namespace PVX::DeepNeuralNets {
+	static unsigned short FloatToHalf(float f) {
+		uint32_t x;
+		memcpy(&x, &f, 4);
+		uint32_t sign = (x >> 16) & 0x8000;
+		uint32_t mant = x & 0x7fffff;
+		int32_t exp = int32_t((x >> 23) & 0xff) - 127 + 15;
+		if (((x >> 23) & 0xff) == 0xff) return sign | 0x7c00 | (mant ? 0x200 : 0);
+		if (exp >= 31) return sign | 0x7c00;
+		if (exp <= 0) {
+			if (exp < -10) return sign;
+			mant |= 0x800000;
+			uint32_t shift = 14 - exp;
+			uint32_t h = mant >> shift, rem = mant & ((1u << shift) - 1), half = 1u << (shift - 1);
+			if (rem > half || (rem == half && (h & 1))) h++;
+			return sign | h;
+		}
+		uint32_t h = (uint32_t(exp) << 10) | (mant >> 13), rem = mant & 0x1fff;
+		if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+		return sign | h;
+	}
+	static float HalfToFloat(unsigned short h) {
+		uint32_t sign = uint32_t(h & 0x8000) << 16, exp = (h >> 10) & 0x1f, mant = h & 0x3ff, x;
+		if (exp == 0x1f) x = sign | 0x7f800000 | (mant << 13);
+		else if (exp) x = sign | ((exp + 112) << 23) | (mant << 13);
+		else if (mant) {
+			exp = 113;
+			while (!(mant & 0x400)) { mant <<= 1; exp--; }
+			x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+		} else x = sign;
+		float ret;
+		memcpy(&ret, &x, 4);
+		return ret;
+	}
+	static unsigned short FloatToBFloat(float f) {
+		uint32_t x;
+		memcpy(&x, &f, 4);
+		if ((x & 0x7fffffff) > 0x7f800000) return (x >> 16) | 0x40;
+		x += 0x7fff + ((x >> 16) & 1);
+		return x >> 16;
+	}
+	static float BFloatToFloat(unsigned short h) {
+		uint32_t x = uint32_t(h) << 16;
+		float ret;
+		memcpy(&ret, &x, 4);
+		return ret;
+	}
+
+	static void LZCompress(const unsigned char* in, size_t n, std::vector<unsigned char>& out) {
+		const int HashBits = 16;
+		std::vector<size_t> Table(1 << HashBits, ~size_t(0));
+		size_t i = 0, anchor = 0;
+		auto Length = [&](size_t len) {
+			for (; len >= 255; len -= 255) out.push_back(255);
+			out.push_back((unsigned char)len);
+		};
+		auto Sequence = [&](size_t LiteralEnd, size_t Match, size_t Offset) {
+			size_t lit = LiteralEnd - anchor, ml = Match ? Match - 4 : 0;
+			out.push_back((unsigned char)((std::min(lit, size_t(15)) << 4) | std::min(ml, size_t(15))));
+			if (lit >= 15) Length(lit - 15);
+			out.insert(out.end(), in + anchor, in + LiteralEnd);
+			if (Match) {
+				out.push_back((unsigned char)(Offset & 0xff));
+				out.push_back((unsigned char)(Offset >> 8));
+				if (ml >= 15) Length(ml - 15);
+			}
+		};
+		while (i + 4 <= n) {
+			uint32_t v, c;
+			memcpy(&v, in + i, 4);
+			auto h = (v * 2654435761u) >> (32 - HashBits);
+			size_t cand = Table[h];
+			Table[h] = i;
+			if (cand != ~size_t(0) && i - cand <= 0xffff && (memcpy(&c, in + cand, 4), c == v)) {
+				size_t len = 4;
+				while (i + len < n && in[cand + len] == in[i + len]) len++;
+				Sequence(i, len, i - cand);
+				i += len;
+				anchor = i;
+			} else i++;
+		}
+		Sequence(n, 0, 0);
+	}
+	static void LZDecompress(const unsigned char* in, size_t n, unsigned char* out, size_t outSize) {
+		size_t ip = 0, op = 0;
+		auto Length = [&](size_t len) {
+			unsigned char b;
+			do {
+				if (ip >= n) throw "Corrupt weight data";
+				b = in[ip++];
+				len += b;
+			} while (b == 255);
+			return len;
+		};
+		while (ip < n) {
+			unsigned char token = in[ip++];
+			size_t lit = token >> 4;
+			if (lit == 15) lit = Length(lit);
+			if (lit > n - ip || lit > outSize - op) throw "Corrupt weight data";
+			memcpy(out + op, in + ip, lit);
+			ip += lit;
+			op += lit;
+			if (ip >= n) break;
+			if (n - ip < 2) throw "Corrupt weight data";
+			size_t offset = in[ip] | (size_t(in[ip + 1]) << 8);
+			ip += 2;
+			size_t ml = token & 15;
+			if (ml == 15) ml = Length(ml);
+			ml += 4;
+			if (!offset || offset > op || ml > outSize - op) throw "Corrupt weight data";
+			for (size_t k = 0; k < ml; k++, op++) out[op] = out[op - offset];
+		}
+		if (op != outSize) throw "Corrupt weight data";
+	}
+
+	std::vector<unsigned char> EncodeWeights(const float* Weights, size_t Count, WeightEncoding Encoding) {
+		std::vector<unsigned char> ret;
+		switch (Encoding) {
+			case WeightEncoding::Float32:
+				ret.resize(Count * sizeof(float));
+				memcpy(ret.data(), Weights, ret.size());
+				break;
+			case WeightEncoding::Float16:
+			case WeightEncoding::BFloat16: {
+				ret.resize(Count * sizeof(unsigned short));
+				auto dst = (unsigned short*)ret.data();
+				if (Encoding == WeightEncoding::Float16)
+					for (size_t i = 0; i < Count; i++) dst[i] = FloatToHalf(Weights[i]);
+				else
+					for (size_t i = 0; i < Count; i++) dst[i] = FloatToBFloat(Weights[i]);
+				break;
+			}
+			case WeightEncoding::ShuffleLZ: {
+				std::vector<unsigned char> Planes(Count * sizeof(float));
+				auto src = (const unsigned char*)Weights;
+				for (size_t b = 0; b < sizeof(float); b++)
+					for (size_t i = 0; i < Count; i++)
+						Planes[b * Count + i] = src[i * sizeof(float) + b];
+				LZCompress(Planes.data(), Planes.size(), ret);
+				break;
+			}
+		}
+		return ret;
+	}
+
+	void DecodeWeights(const unsigned char* Data, size_t Size, WeightEncoding Encoding, float* Weights, size_t Count) {
+		switch (Encoding) {
+			case WeightEncoding::Float32:
+				if (Size != Count * sizeof(float)) throw "Corrupt weight data";
+				memcpy(Weights, Data, Size);
+				break;
+			case WeightEncoding::Float16:
+			case WeightEncoding::BFloat16: {
+				if (Size != Count * sizeof(unsigned short)) throw "Corrupt weight data";
+				auto src = (const unsigned short*)Data;
+				if (Encoding == WeightEncoding::Float16)
+					for (size_t i = 0; i < Count; i++) Weights[i] = HalfToFloat(src[i]);
+				else
+					for (size_t i = 0; i < Count; i++) Weights[i] = BFloatToFloat(src[i]);
+				break;
+			}
+			case WeightEncoding::ShuffleLZ: {
+				std::vector<unsigned char> Planes(Count * sizeof(float));
+				LZDecompress(Data, Size, Planes.data(), Planes.size());
+				auto dst = (unsigned char*)Weights;
+				for (size_t b = 0; b < sizeof(float); b++)
+					for (size_t i = 0; i < Count; i++)
+						dst[i * sizeof(float) + b] = Planes[b * Count + i];
+				break;
+			}
+			default:
+				throw "Unknown weight encoding";
+		}
+	}
+
+	std::vector<NetContainer::EncodingStats> NetContainer::CompareEncodings(const netData& Input) {
+		std::vector<EncodingStats> ret;
+		ResetRNN();
+		netData Reference = Process(Input);
+		NetContainer Copy(*this);
+		for (auto Encoding : { WeightEncoding::Float32, WeightEncoding::Float16, WeightEncoding::BFloat16, WeightEncoding::ShuffleLZ }) {
+			EncodingStats st{ Encoding, 0, 0.0f, 0.0f };
+			for (size_t i = 0; i < DenseLayers.size(); i++) {
+				auto w = DenseLayers[i]->WeightsView();
+				auto& dst = Copy.DenseLayers[i]->Weights;
+				auto Data = EncodeWeights(w.data(), w.size(), Encoding);
+				st.Bytes += Data.size();
+				dst.resize(w.rows(), w.cols());
+				Copy.DenseLayers[i]->WeightView = nullptr;
+				DecodeWeights(Data.data(), Data.size(), Encoding, dst.data(), dst.size());
+				st.MaxWeightError = std::max(st.MaxWeightError, (dst - w).cwiseAbs().maxCoeff());
+			}
+			Copy.ResetRNN();
+			st.OutputError = std::sqrt((Copy.Process(Input) - Reference).squaredNorm() / std::max(Reference.size(), Eigen::Index(1)));
+			ret.push_back(st);
+		}
+		return ret;
+	}
+}
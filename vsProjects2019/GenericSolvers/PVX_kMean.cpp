@@ -1,73 +1,342 @@
 #include <PVX_Solvers.h>
 #include <vector>
+#include <set>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <cfloat>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace PVX {
 	namespace Solvers {
+		static const int64_t BlockSize = 4096;
 
-		inline static float dist2(const std::vector<float>& a, const std::vector<float>& b) {
-			float dist = 0;
-			for (size_t i = 0; i < a.size(); i++) {
-				float sub = a[i] - b[i];
-				dist += sub * sub;
+		struct ThreadSums {
+			Eigen::MatrixXf Sums, D;
+			std::vector<int64_t> Counts;
+			int64_t Changed;
+		};
+
+		static int ThreadCount(int Threads) {
+			return Threads > 0 ? Threads : int(std::max(1u, std::thread::hardware_concurrency()));
+		}
+
+		template<typename F>
+		static void ParallelBlocks(int64_t Count, int Threads, F&& fnc) {
+			const int64_t nBlocks = (Count + BlockSize - 1) / BlockSize;
+			const int nThreads = int(std::min(int64_t(Threads), nBlocks));
+			std::atomic<int64_t> Next = 0;
+			std::exception_ptr Failed;
+			std::mutex FailLock;
+			auto Work = [&](int t) {
+				try {
+					for (int64_t b; (b = Next++) < nBlocks;)
+						fnc(t, b, b * BlockSize, std::min(BlockSize, Count - b * BlockSize));
+				} catch (...) {
+					std::lock_guard<std::mutex> lock{ FailLock };
+					if (!Failed) Failed = std::current_exception();
+					Next = nBlocks;
+				}
+			};
+#ifdef _OPENMP
+			if (nThreads > 1) {
+				#pragma omp parallel num_threads(nThreads)
+				Work(omp_get_thread_num());
+			} else Work(0);
+#else
+			std::vector<std::thread> Workers;
+			for (int t = 1; t < nThreads; t++) Workers.emplace_back(Work, t);
+			Work(0);
+			for (auto& w : Workers) w.join();
+#endif
+			if (Failed) std::rethrow_exception(Failed);
+		}
+
+		template<typename X, typename C>
+		static float Distance2(const X& x, const C& c) {
+			return (x - c).squaredNorm();
+		}
+
+		static void SeedRandom(const Eigen::MatrixXf& Points, Eigen::MatrixXf& C, std::mt19937_64& gen) {
+			std::uniform_int_distribution<int64_t> Pick(0, Points.cols() - 1);
+			std::set<int64_t> Used;
+			for (int64_t k = 0; k < C.cols(); k++) {
+				int64_t i;
+				do i = Pick(gen); while (!Used.insert(i).second);
+				C.col(k) = Points.col(i);
 			}
-			return dist;
 		}
-		inline static void AddTo(std::vector<float>& a, const std::vector<float>& b) {
-			for (auto i = 0; i<a.size(); i++) {
-				a[i] += b[i];
+
+		static void SeedPlusPlus(const Eigen::MatrixXf& Points, Eigen::MatrixXf& C, std::mt19937_64& gen, int Threads) {
+			const int64_t Count = Points.cols(), K = C.cols(), nBlocks = (Count + BlockSize - 1) / BlockSize;
+			const int Trials = 2 + int(std::log(double(K)));
+			std::vector<float> MinD(Count, FLT_MAX);
+			std::vector<double> BlockSum(nBlocks), TrialSum(nBlocks * Trials);
+			std::vector<int64_t> Candidates(Trials);
+
+			auto Include = [&](int64_t Center) {
+				auto c = Points.col(Center);
+				ParallelBlocks(Count, Threads, [&](int, int64_t b, int64_t Start, int64_t n) {
+					double Sum = 0;
+					for (int64_t i = Start; i < Start + n; i++) {
+						MinD[i] = std::min(MinD[i], (Points.col(i) - c).squaredNorm());
+						Sum += MinD[i];
+					}
+					BlockSum[b] = Sum;
+				});
+			};
+			auto Sample = [&](double Total) {
+				if (Total <= 0) return std::uniform_int_distribution<int64_t>(0, Count - 1)(gen);
+				double r = std::uniform_real_distribution<double>(0, Total)(gen);
+				int64_t b = 0;
+				while (b < nBlocks - 1 && r >= BlockSum[b]) r -= BlockSum[b++];
+				int64_t Pick = b * BlockSize, Last = std::min(Pick + BlockSize, Count) - 1;
+				while (Pick < Last && r >= MinD[Pick]) r -= MinD[Pick++];
+				return Pick;
+			};
+
+			int64_t First = std::uniform_int_distribution<int64_t>(0, Count - 1)(gen);
+			C.col(0) = Points.col(First);
+			Include(First);
+			for (int64_t k = 1; k < K; k++) {
+				double Total = 0;
+				for (auto s : BlockSum) Total += s;
+				for (auto& c : Candidates) c = Sample(Total);
+				ParallelBlocks(Count, Threads, [&](int, int64_t b, int64_t Start, int64_t n) {
+					for (int t = 0; t < Trials; t++) {
+						auto c = Points.col(Candidates[t]);
+						double Sum = 0;
+						for (int64_t i = Start; i < Start + n; i++)
+							Sum += std::min(MinD[i], (Points.col(i) - c).squaredNorm());
+						TrialSum[b * Trials + t] = Sum;
+					}
+				});
+				int Best = 0;
+				double BestSum = DBL_MAX;
+				for (int t = 0; t < Trials; t++) {
+					double Sum = 0;
+					for (int64_t b = 0; b < nBlocks; b++) Sum += TrialSum[b * Trials + t];
+					if (Sum < BestSum) { BestSum = Sum; Best = t; }
+				}
+				C.col(k) = Points.col(Candidates[Best]);
+				if (k + 1 < K) Include(Candidates[Best]);
 			}
 		}
 
-		std::vector<std::vector<float>> kMean(const std::vector<std::vector<float>>& vecs, size_t nClusters) {
-			auto vecSize = vecs[0].size();
-			std::default_random_engine gen;
-			std::uniform_int_distribution<int> rBool(0, 1);
-			std::vector<int> Cluster(vecs.size());
-			for (size_t i = 0; i<vecs.size(); i++) Cluster[i] = i;
-			std::partial_sort(Cluster.begin(), Cluster.begin() + nClusters, Cluster.end(), [&rBool, &gen](const auto& a, const auto& b) { return rBool(gen); });
-
-			std::vector<std::vector<float>> ret, tmp;
-			std::vector<size_t> Counts(nClusters);
-			ret.reserve(nClusters);
-			tmp.reserve(nClusters);
-			for (auto i = 0; i<nClusters; i++) {
-				ret.push_back(vecs[Cluster[i]]);
-				tmp.emplace_back(vecSize);
+		static int64_t AssignAll(const Eigen::MatrixXf& Points, const Eigen::MatrixXf& C, std::vector<int>& Labels, float* Upper, float* Lower, std::vector<ThreadSums>& Parts) {
+			const int64_t K = C.cols();
+			const Eigen::MatrixXf Ct = C.transpose();
+			const Eigen::VectorXf CNorm = C.colwise().squaredNorm().transpose();
+			const float Tol = 4.0f * Points.rows() * FLT_EPSILON, CMax = CNorm.maxCoeff();
+			for (auto& p : Parts) {
+				p.Sums.setZero(C.rows(), K);
+				p.Counts.assign(K, 0);
+				p.Changed = 0;
 			}
+			ParallelBlocks(Points.cols(), int(Parts.size()), [&](int t, int64_t, int64_t Start, int64_t n) {
+				auto& p = Parts[t];
+				auto X = Points.middleCols(Start, n);
+				p.D.noalias() = Ct * X;
+				for (int64_t j = 0; j < n; j++) {
+					const float* d = p.D.col(j).data();
+					auto x = X.col(j);
+					const float xn = x.squaredNorm(), Err = Tol * (xn + CMax);
+					float Screen = FLT_MAX;
+					for (int64_t k = 0; k < K; k++) Screen = std::min(Screen, CNorm[k] - 2.0f * d[k]);
+					Screen += 2.0f * Err;
+
+					auto& Label = Labels[Start + j];
+					int best = -1;
+					float min = FLT_MAX;
+					if (Label >= 0 && CNorm[Label] - 2.0f * d[Label] <= Screen) {
+						best = Label;
+						min = Distance2(x, C.col(Label));
+					}
+					for (int64_t k = 0; k < K; k++) {
+						if (k == Label || CNorm[k] - 2.0f * d[k] > Screen) continue;
+						float v = Distance2(x, C.col(k));
+						if (v < min) { min = v; best = int(k); }
+					}
+					if (Upper) Upper[Start + j] = std::sqrt(min);
+					if (Lower) {
+						float second = FLT_MAX;
+						for (int64_t k = 0; k < K; k++) if (k != best) second = std::min(second, CNorm[k] - 2.0f * d[k]);
+						Lower[Start + j] = K > 1 ? std::sqrt(std::max(0.0f, second + xn - Err)) : FLT_MAX;
+					}
+					if (Label != best) { Label = best; p.Changed++; }
+					p.Sums.col(best) += x;
+					p.Counts[best]++;
+				}
+			});
+			int64_t Changed = 0;
+			for (auto& p : Parts) Changed += p.Changed;
+			return Changed;
+		}
 
-			int notFinished = 1;
-			while(notFinished) {
-				notFinished = 0;
+		static int64_t AssignHamerly(const Eigen::MatrixXf& Points, const Eigen::MatrixXf& C, const Eigen::VectorXf& Moves, std::vector<int>& Labels, float* Upper, float* Lower, std::vector<ThreadSums>& Parts) {
+			const int64_t K = C.cols();
+			Eigen::Index Fastest;
+			float m1 = Moves.maxCoeff(&Fastest), m2 = 0;
+			for (int64_t k = 0; k < K; k++) if (k != Fastest) m2 = std::max(m2, Moves[k]);
 
-				size_t cur = 0;
-				for (auto& t : tmp) {
-					memset(t.data(), 0, sizeof(float) * vecSize);
-					Counts[cur++] = 0;
+			Eigen::MatrixXf CC = C.transpose() * C;
+			Eigen::VectorXf Half(K);
+			for (int64_t k = 0; k < K; k++) {
+				float min = FLT_MAX;
+				for (int64_t o = 0; o < K; o++) {
+					if (o == k) continue;
+					float s = CC(k, k) + CC(o, o);
+					min = std::min(min, s - 2.0f * CC(k, o) - 4.0f * C.rows() * FLT_EPSILON * s);
 				}
-				cur = 0;
-
-				for (auto& vec : vecs) {
-					size_t min = 0;
-					float minDist = dist2(ret[0], vec);
-					for (auto c = 1; c<nClusters; c++) {
-						float dist = dist2(ret[c], vec);
-						if (dist < minDist) { min = c; minDist = dist; }
+				Half[k] = 0.5f * std::sqrt(std::max(0.0f, min));
+			}
+
+			for (auto& p : Parts) {
+				p.Sums.setZero(C.rows(), K);
+				p.Counts.assign(K, 0);
+				p.Changed = 0;
+			}
+			ParallelBlocks(Points.cols(), int(Parts.size()), [&](int t, int64_t, int64_t Start, int64_t n) {
+				auto& p = Parts[t];
+				for (int64_t i = Start; i < Start + n; i++) {
+					auto x = Points.col(i);
+					int a = Labels[i];
+					Upper[i] += Moves[a];
+					Lower[i] -= a == Fastest ? m2 : m1;
+					float m = std::max(Half[a], Lower[i]);
+					if (Upper[i] > m) {
+						float Own = Distance2(x, C.col(a));
+						Upper[i] = std::sqrt(Own);
+						if (Upper[i] > m) {
+							int best = a;
+							float min = Own, second = FLT_MAX;
+							for (int64_t k = 0; k < K; k++) {
+								if (k == a) continue;
+								float v = Distance2(x, C.col(k));
+								if (v < min) { second = min; min = v; best = int(k); }
+								else if (v < second) second = v;
+							}
+							Upper[i] = std::sqrt(min);
+							Lower[i] = std::sqrt(second);
+							if (best != a) { Labels[i] = a = best; p.Changed++; }
+						}
 					}
-					notFinished |= min!=Cluster[cur];
-					Cluster[cur++] = min;
-					AddTo(tmp[min], vec);
-					Counts[min]++;
+					p.Sums.col(a) += x;
+					p.Counts[a]++;
 				}
-				for (auto i = 0; i<nClusters; i++) {
-					float inv = 1.0f / Counts[i];
-					auto& t = tmp[i];
-					auto& r = ret[i];
-					for (auto j = 0; j<vecSize; j++) {
-						r[j] = t[j] * inv;
-					}
+			});
+			int64_t Changed = 0;
+			for (auto& p : Parts) Changed += p.Changed;
+			return Changed;
+		}
+
+		static void MoveCentroids(const Eigen::MatrixXf& Points, Eigen::MatrixXf& C, std::vector<ThreadSums>& Parts, const std::vector<float>& Upper, Eigen::VectorXf& Moves) {
+			auto& Total = Parts[0];
+			for (size_t t = 1; t < Parts.size(); t++) {
+				Total.Sums += Parts[t].Sums;
+				for (int64_t k = 0; k < C.cols(); k++) Total.Counts[k] += Parts[t].Counts[k];
+			}
+			Eigen::MatrixXf Old = C;
+			std::set<int64_t> Taken;
+			for (int64_t k = 0; k < C.cols(); k++) {
+				if (Total.Counts[k]) {
+					C.col(k) = Total.Sums.col(k) / float(Total.Counts[k]);
+					continue;
 				}
+				int64_t Far = -1;
+				for (int64_t i = 0; i < int64_t(Upper.size()); i++)
+					if ((Far < 0 || Upper[i] > Upper[Far]) && !Taken.count(i)) Far = i;
+				Taken.insert(Far);
+				C.col(k) = Points.col(Far);
 			}
-			return std::move(ret);
+			Moves = (C - Old).colwise().norm().transpose();
+		}
+
+		std::vector<std::vector<float>> kMean(const std::vector<std::vector<float>>& vecs, size_t nClusters) {
+			auto vecSize = vecs[0].size();
+			Eigen::MatrixXf Points(vecSize, vecs.size());
+			for (size_t i = 0; i < vecs.size(); i++)
+				memcpy(Points.col(i).data(), vecs[i].data(), sizeof(float) * vecSize);
+
+			auto res = kMean(Points, nClusters);
+
+			std::vector<std::vector<float>> ret;
+			ret.reserve(nClusters);
+			for (size_t i = 0; i < nClusters; i++)
+				ret.emplace_back(res.Centroids.col(i).data(), res.Centroids.col(i).data() + vecSize);
+			return ret;
+		}
+
+		kMeanResult kMean(const Eigen::MatrixXf& Points, size_t nClusters, const kMeanOptions& Options) {
+			const int64_t Count = Points.cols(), K = int64_t(nClusters);
+			if (!Count || !K || K > Count) throw "Invalid cluster count";
+			const int Threads = ThreadCount(Options.Threads);
+			std::mt19937_64 gen(Options.Seed);
+
+			kMeanResult ret;
+			ret.Labels.assign(Count, -1);
+			ret.Centroids.resize(Points.rows(), K);
+			if (Options.Init == kMeanInit::PlusPlus)
+				SeedPlusPlus(Points, ret.Centroids, gen, Threads);
+			else
+				SeedRandom(Points, ret.Centroids, gen);
+
+			std::vector<float> Upper(Count), Lower(Options.Accelerated ? Count : 0);
+			std::vector<ThreadSums> Parts(Threads);
+			Eigen::VectorXf Moves;
+			int64_t Changed = AssignAll(Points, ret.Centroids, ret.Labels, Upper.data(), Options.Accelerated ? Lower.data() : nullptr, Parts);
+			ret.Iterations = 1;
+			while (Changed && ret.Iterations < Options.MaxIterations) {
+				MoveCentroids(Points, ret.Centroids, Parts, Upper, Moves);
+				if (Options.Accelerated)
+					Changed = AssignHamerly(Points, ret.Centroids, Moves, ret.Labels, Upper.data(), Lower.data(), Parts);
+				else
+					Changed = AssignAll(Points, ret.Centroids, ret.Labels, Upper.data(), nullptr, Parts);
+				ret.Iterations++;
+			}
+			if (Changed) MoveCentroids(Points, ret.Centroids, Parts, Upper, Moves);
+
+			std::vector<double> BlockInertia((Count + BlockSize - 1) / BlockSize);
+			ParallelBlocks(Count, Threads, [&](int, int64_t b, int64_t Start, int64_t n) {
+				double Sum = 0;
+				for (int64_t i = Start; i < Start + n; i++)
+					Sum += (Points.col(i) - ret.Centroids.col(ret.Labels[i])).squaredNorm();
+				BlockInertia[b] = Sum;
+			});
+			ret.Inertia = 0;
+			for (auto s : BlockInertia) ret.Inertia += s;
+			return ret;
+		}
+
+		kMeanMiniBatch::kMeanMiniBatch(size_t nClusters, uint64_t Seed, int Threads) :
+			nClusters{ nClusters },
+			Threads{ ThreadCount(Threads) },
+			gen(Seed),
+			Counts(nClusters) {}
+
+		void kMeanMiniBatch::Update(const Eigen::MatrixXf& Batch) {
+			if (!Centroids.size()) {
+				if (Batch.cols() < int64_t(nClusters)) throw "Batch smaller than cluster count";
+				Centroids.resize(Batch.rows(), nClusters);
+				SeedPlusPlus(Batch, Centroids, gen, Threads);
+			}
+			Labels.assign(Batch.cols(), -1);
+			std::vector<ThreadSums> Parts(Threads);
+			AssignAll(Batch, Centroids, Labels, nullptr, nullptr, Parts);
+			for (int64_t j = 0; j < Batch.cols(); j++) {
+				auto k = Labels[j];
+				float eta = 1.0f / ++Counts[k];
+				Centroids.col(k) += eta * (Batch.col(j) - Centroids.col(k));
+			}
+		}
+
+		std::vector<int> kMeanMiniBatch::Predict(const Eigen::MatrixXf& Points) const {
+			std::vector<int> ret(Points.cols(), -1);
+			std::vector<ThreadSums> Parts(Threads);
+			AssignAll(Points, Centroids, ret, nullptr, nullptr, Parts);
+			return ret;
 		}
 	}
-}
\ No newline at end of file
+}
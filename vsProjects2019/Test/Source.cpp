@@ -12,6 +12,23 @@ netData OneHot2();
 
 
 int main() {
+	if(false)
+	{
+		InputLayer Input("Input", 64);
+		NeuronLayer Dense0(&Input, 64);
+		NeuronLayer Dense1(&Dense0, 16);
+		NetContainer Net(&Dense1, OutputType::MeanSquare);
+		netData In = netData::Random(64, 32);
+		netData Expected = Net.Process(In);
+
+		for (auto Encoding : { WeightEncoding::Float32, WeightEncoding::Float16, WeightEncoding::BFloat16, WeightEncoding::ShuffleLZ }) {
+			NeuralLayer_Base::SaveWeightsAs(Encoding);
+			Net.Save(L"Codec.pvx");
+			NetContainer Loaded(L"Codec.pvx");
+			std::cout << int(Encoding) << " " << (Loaded.Process(In) - Expected).cwiseAbs().maxCoeff() << "\n";
+		}
+		NeuralLayer_Base::SaveWeightsAs(WeightEncoding::Float32);
+	}
 	if(true)
 	{
 		NeuralLayer_Base::LearnRate(0.01f);